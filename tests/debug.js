@@ -54,16 +54,6 @@ function dumpBytes(bytes, offset, length) {
   printf('++++++++++++++++++++++++++++++++++++++++++\n');
 }
 
-/**
- * @param {!xd3_hinst} inst1
- * @param {!xd3_hinst} inst2
- */
-function printInstructionPair(inst1, inst2) {
-  printf(
-      typeToTypeString(inst1.type) + '/' + inst1.size + '/' + typeToMode(inst1.type) + ' : ' +
-      typeToTypeString(inst2.type) + '/' + inst2.size + '/' + typeToMode(inst2.type) + "\n");
-}
-
 function dumpCodeTableRows(tableRows, startRow, endRow) {
   var output = '';
   output += '==============================================\n';
@@ -0,0 +1,291 @@
+/**
+ * A DJW static Huffman compressor for building test deltas, the encoding
+ * side of the decoder's DJW secondary compressor (xdelta3-djw.h).
+ *
+ * With more than one group the section is split into sectors of
+ * sectorSize bytes, and each sector is given the group whose code codes it
+ * in the fewest bits, in a few rounds like the C encoder's iterations.
+ * Every group codes every byte of the section, so the code lengths of the
+ * later groups need not say which bytes are unused.
+ *
+ * Use it with VcdiffWriter.setSecondary(DJW_ID, DjwCompressor.compressor()).
+ */
+var DJW_ID = 1;
+
+var DjwCompressor = {};
+
+DjwCompressor.MAX_CODELEN = 20;
+DjwCompressor.MAX_CLCLEN = 15;
+DjwCompressor.MAX_GBCLEN = 7;
+DjwCompressor.ITERATIONS = 4;
+
+/**
+ * Returns a compress function for VcdiffWriter.setSecondary.
+ * @param {number=} opt_groups From 1 to 8, default 1.
+ * @param {number=} opt_sectorSize A multiple of 5 up to 160, default 100.
+ * @return {function(number, !Array<number>): !Array<number>}
+ */
+DjwCompressor.compressor = function(opt_groups, opt_sectorSize) {
+  return function(section, bytes) {
+    return DjwCompressor.compress(bytes, opt_groups, opt_sectorSize);
+  };
+};
+
+/**
+ * Compresses a section.
+ * @param {!Array<number>|!Uint8Array} bytes At least one byte.
+ * @param {number=} opt_groups
+ * @param {number=} opt_sectorSize
+ * @return {!Array<number>}
+ */
+DjwCompressor.compress = function(bytes, opt_groups, opt_sectorSize) {
+  if (bytes.length == 0) {
+    throw new Error('DJW cannot code an empty section');
+  }
+  var groups = opt_groups || 1;
+  var sectorSize = groups > 1 ? (opt_sectorSize || 100) : bytes.length;
+  if (groups < 1 || groups > 8 ||
+      (groups > 1 && (sectorSize % 5 || sectorSize > 160))) {
+    throw new Error('invalid DJW groups or sector size');
+  }
+  var sectors = Math.ceil(bytes.length / sectorSize);
+
+  var used = new Array(256).fill(0);
+  for (var i = 0; i < bytes.length; i++) {
+    used[bytes[i]] = 1;
+  }
+
+  // Assign the sectors to groups: start with runs of sectors, then move
+  // each sector to its cheapest code.
+  var sel = [];
+  for (var c = 0; c < sectors; c++) {
+    sel.push(Math.floor(c * groups / sectors));
+  }
+  var clens;
+  for (var iter = 0; ; iter++) {
+    var freqs = [];
+    for (var g = 0; g < groups; g++) {
+      freqs.push(used.slice());
+    }
+    for (var i = 0; i < bytes.length; i++) {
+      freqs[sel[Math.floor(i / sectorSize)]][bytes[i]]++;
+    }
+    clens = freqs.map(function(f) {
+      return DjwCompressor.codeLengths(f, DjwCompressor.MAX_CODELEN);
+    });
+    if (groups == 1 || iter == DjwCompressor.ITERATIONS) {
+      break;
+    }
+    for (var c = 0; c < sectors; c++) {
+      var best = Infinity;
+      for (var g = 0; g < groups; g++) {
+        var cost = 0;
+        var end = Math.min((c + 1) * sectorSize, bytes.length);
+        for (var i = c * sectorSize; i < end; i++) {
+          cost += clens[g][bytes[i]];
+        }
+        if (cost < best) {
+          best = cost;
+          sel[c] = g;
+        }
+      }
+    }
+  }
+
+  var out = new DjwCompressor.BitWriter();
+  out.bits(3, groups - 1);
+  if (groups > 1) {
+    out.bits(5, sectorSize / 5 - 1);
+  }
+
+  // The code lengths of the groups, the later groups without the unused
+  // bytes, move-to-front coded.
+  var values = clens[0].slice();
+  for (var g = 1; g < groups; g++) {
+    for (var b = 0; b < 256; b++) {
+      if (used[b]) {
+        values.push(clens[g][b]);
+      }
+    }
+  }
+  var clmtf = [0, 4, 5, 6, 7, 8, 9, 10, 3, 11, 2, 12, 13, 1, 14, 15, 16, 17,
+               18, 19, 20];
+  var clSyms = DjwCompressor.mtf12(values, clmtf);
+  var clFreq = new Array(22).fill(0);
+  clSyms.forEach(function(s) { clFreq[s]++; });
+  var clclen = DjwCompressor.codeLengths(clFreq, DjwCompressor.MAX_CLCLEN);
+  var num = 22;
+  while (num > 7 && clclen[num - 1] == 0) {
+    num--;
+  }
+  out.bits(4, num - 7);
+  for (var i = 0; i < num; i++) {
+    out.bits(4, clclen[i]);
+  }
+  out.symbols(clSyms, clclen);
+
+  if (groups > 1) {
+    var gbmtf = [];
+    for (var g = 0; g < groups; g++) {
+      gbmtf.push(g);
+    }
+    var gbSyms = DjwCompressor.mtf12(sel, gbmtf);
+    var gbFreq = new Array(groups + 1).fill(0);
+    gbSyms.forEach(function(s) { gbFreq[s]++; });
+    var gbclen = DjwCompressor.codeLengths(gbFreq, DjwCompressor.MAX_GBCLEN);
+    for (var i = 0; i <= groups; i++) {
+      out.bits(3, gbclen[i]);
+    }
+    out.symbols(gbSyms, gbclen);
+  }
+
+  var codes = clens.map(DjwCompressor.canonicalCodes);
+  for (var i = 0; i < bytes.length; i++) {
+    var g = sel[Math.floor(i / sectorSize)];
+    out.bits(clens[g][bytes[i]], codes[g][bytes[i]]);
+  }
+  return out.finish();
+};
+
+/**
+ * Move-to-front codes values: a repeat of the front value is counted, and
+ * the count is written in bijective base 2 with RUN_0 (0) for a 1 and
+ * RUN_1 (1) for a 2, least significant digit first. Any other value is 1
+ * more than its position.
+ * @param {!Array<number>} values
+ * @param {!Array<number>} mtf The initial order, which is changed.
+ * @return {!Array<number>} The symbols.
+ */
+DjwCompressor.mtf12 = function(values, mtf) {
+  var syms = [];
+  var run = 0;
+  var flush = function() {
+    while (run > 0) {
+      if (run & 1) {
+        syms.push(0);
+        run = (run - 1) / 2;
+      } else {
+        syms.push(1);
+        run = (run - 2) / 2;
+      }
+    }
+  };
+  for (var i = 0; i < values.length; i++) {
+    var pos = mtf.indexOf(values[i]);
+    if (pos == 0) {
+      run++;
+      continue;
+    }
+    flush();
+    mtf.splice(pos, 1);
+    mtf.unshift(values[i]);
+    syms.push(pos + 1);
+  }
+  flush();
+  return syms;
+};
+
+/**
+ * Huffman code lengths of the frequencies, no longer than maxLen. A code
+ * too long is rebuilt from the frequencies halved.
+ * @param {!Array<number>} freq
+ * @param {number} maxLen
+ * @return {!Array<number>} The lengths, 0 for a frequency of 0.
+ */
+DjwCompressor.codeLengths = function(freq, maxLen) {
+  freq = freq.slice();
+  for (;;) {
+    var nodes = [];
+    for (var s = 0; s < freq.length; s++) {
+      if (freq[s]) {
+        nodes.push({freq: freq[s], syms: [s]});
+      }
+    }
+    var lens = new Array(freq.length).fill(0);
+    if (nodes.length == 1) {
+      lens[nodes[0].syms[0]] = 1;
+      return lens;
+    }
+    while (nodes.length > 1) {
+      nodes.sort(function(a, b) { return a.freq - b.freq; });
+      var a = nodes.shift();
+      var b = nodes.shift();
+      a.syms.concat(b.syms).forEach(function(s) { lens[s]++; });
+      nodes.push({freq: a.freq + b.freq, syms: a.syms.concat(b.syms)});
+    }
+    if (Math.max.apply(null, lens) <= maxLen) {
+      return lens;
+    }
+    freq = freq.map(function(f) { return f ? (f >> 1) + 1 : 0; });
+  }
+};
+
+/**
+ * The canonical codes of the lengths: shorter codes first, and the symbols
+ * of a length in order.
+ * @param {!Array<number>} lens
+ * @return {!Array<number>}
+ */
+DjwCompressor.canonicalCodes = function(lens) {
+  var codes = new Array(lens.length).fill(0);
+  var code = 0;
+  for (var len = 1; len <= 20; len++) {
+    for (var s = 0; s < lens.length; s++) {
+      if (lens[s] == len) {
+        codes[s] = code++;
+      }
+    }
+    code <<= 1;
+  }
+  return codes;
+};
+
+/**
+ * Writes values most significant bit first, from the low bit of each byte
+ * up.
+ * @constructor
+ */
+DjwCompressor.BitWriter = function() {
+  this.bytes = [];
+  this.cur = 0;
+  this.mask = 1;
+};
+
+/**
+ * @param {number} nbits
+ * @param {number} value
+ */
+DjwCompressor.BitWriter.prototype.bits = function(nbits, value) {
+  for (var i = nbits - 1; i >= 0; i--) {
+    if ((value >> i) & 1) {
+      this.cur |= this.mask;
+    }
+    this.mask <<= 1;
+    if (this.mask == 0x100) {
+      this.bytes.push(this.cur);
+      this.cur = 0;
+      this.mask = 1;
+    }
+  }
+};
+
+/**
+ * @param {!Array<number>} syms
+ * @param {!Array<number>} lens
+ */
+DjwCompressor.BitWriter.prototype.symbols = function(syms, lens) {
+  var codes = DjwCompressor.canonicalCodes(lens);
+  for (var i = 0; i < syms.length; i++) {
+    this.bits(lens[syms[i]], codes[syms[i]]);
+  }
+};
+
+/**
+ * @return {!Array<number>}
+ */
+DjwCompressor.BitWriter.prototype.finish = function() {
+  if (this.mask != 1) {
+    this.bytes.push(this.cur);
+  }
+  return this.bytes;
+};
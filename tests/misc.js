@@ -35,3 +35,20 @@
     var msgEle = document.getElementById(id);
     msgEle.innerHTML += '<tr><td align="right">' + name + ':</td><td>' + path + '</td></tr>';
   }
+
+  // Load files one after another, then call callback with an object of
+  // their bytes by url.
+  function loadFiles(urls, callback) {
+    var files = {};
+    var next = function(i) {
+      if (i == urls.length) {
+        callback(files);
+        return;
+      }
+      loadFile(urls[i], function(bytes) {
+        files[urls[i]] = bytes;
+        next(i + 1);
+      });
+    };
+    next(0);
+  }
@@ -0,0 +1,729 @@
+/**
+ * A minimal VCDIFF writer for building synthetic test deltas.
+ *
+ * Only the single-instruction rows of the RFC 3284 default code table and
+ * VCD_SELF addresses are used, which is enough to reach every decoder path
+ * without an XDelta3 encoder. While writing, the target is built with naive
+ * byte-at-a-time semantics so a test can compare the decoder against it.
+ *
+ * Instructions are arrays:
+ *   ['ADD', bytes]       add the bytes
+ *   ['RUN', byte, size]  repeat the byte size times
+ *   ['COPY', addr, size] copy from the copy window + target window address
+ */
+
+/**
+ * @param {Uint8Array=} opt_source The source the deltas will be applied to.
+ * @constructor
+ */
+function VcdiffWriter(opt_source) {
+  this.source = opt_source || new Uint8Array(0);
+  this.bytes = [0xD6, 0xC3, 0xC4, 0, 0];
+  this.targetParts = [];
+  this.targetLength = 0;
+  this.secondary = null;
+  this.codeTable = null;
+}
+
+VcdiffWriter.VCD_SOURCE = 0x01;
+VcdiffWriter.VCD_TARGET = 0x02;
+VcdiffWriter.VCD_ADLER32 = 0x04;
+
+/**
+ * Compresses the sections of the windows added after this with a secondary
+ * compressor. Must be called before the first window.
+ * @param {number} id The secondary compressor ID.
+ * @param {function(number, !Array<number>): !Array<number>} compress Called
+ *     with the section (0 data, 1 inst, 2 addr) and its bytes, returns the
+ *     compressor's data.
+ * @param {number=} opt_del_ind The sections to compress, default all.
+ */
+VcdiffWriter.prototype.setSecondary = function(id, compress, opt_del_ind) {
+  if (this.bytes[4] & 0x02) {
+    throw new Error('setSecondary after setCodeTable');
+  }
+  if (this.bytes.length != 5) {
+    throw new Error('setSecondary after a window');
+  }
+  this.bytes[4] |= 0x01;  // VCD_SECONDARY
+  this.bytes.push(id);
+  this.secondary = {
+    compress: compress,
+    del_ind: (opt_del_ind === undefined) ? 7 : opt_del_ind
+  };
+};
+
+/**
+ * The parameters of the RFC 3284 default code table, see buildCodeTable.
+ */
+VcdiffWriter.RFC3284_CODE_TABLE = {
+  add_sizes: 17,
+  near_modes: 4,
+  same_modes: 3,
+  cpy_sizes: 15,
+  addcopy_add_max: 4,
+  addcopy_near_cpy_max: 6,
+  addcopy_same_cpy_max: 4,
+  copyadd_add_max: 1,
+  copyadd_near_cpy_max: 4,
+  copyadd_same_cpy_max: 4
+};
+
+/**
+ * Builds code table rows the way XDelta3 builds its tables: one RUN, the
+ * ADD sizes, the COPY sizes of each mode, then the ADD/COPY and COPY/ADD
+ * pairs. Rows past the last are NOOP.
+ *
+ * A row is {type1, size1, mode1, type2, size2, mode2}, where a type is 0
+ * NOOP, 1 ADD, 2 RUN or 3 COPY and a size of 0 is read from the INST
+ * section.
+ * @param {!Object<string, number>} desc Like RFC3284_CODE_TABLE.
+ * @return {!Array<!Object<string, number>>} The 256 rows.
+ */
+VcdiffWriter.buildCodeTable = function(desc) {
+  var rows = [];
+  var row = function(type1, size1, mode1, type2, size2, mode2) {
+    rows.push({type1: type1, size1: size1, mode1: mode1,
+               type2: type2, size2: size2, mode2: mode2});
+  };
+  var modes = 2 + desc.near_modes + desc.same_modes;
+  var size1, size2, mode;
+
+  row(2, 0, 0, 0, 0, 0);
+  for (size1 = 0; size1 <= desc.add_sizes; size1++) {
+    row(1, size1, 0, 0, 0, 0);
+  }
+  for (mode = 0; mode < modes; mode++) {
+    row(3, 0, mode, 0, 0, 0);
+    for (size1 = 4; size1 < 4 + desc.cpy_sizes; size1++) {
+      row(3, size1, mode, 0, 0, 0);
+    }
+  }
+  for (mode = 0; mode < modes; mode++) {
+    var max = (mode < 2 + desc.near_modes) ? desc.addcopy_near_cpy_max :
+        desc.addcopy_same_cpy_max;
+    for (size1 = 1; size1 <= desc.addcopy_add_max; size1++) {
+      for (size2 = 4; size2 <= max; size2++) {
+        row(1, size1, 0, 3, size2, mode);
+      }
+    }
+  }
+  for (mode = 0; mode < modes; mode++) {
+    var max = (mode < 2 + desc.near_modes) ? desc.copyadd_near_cpy_max :
+        desc.copyadd_same_cpy_max;
+    for (size1 = 4; size1 <= max; size1++) {
+      for (size2 = 1; size2 <= desc.copyadd_add_max; size2++) {
+        row(3, size1, mode, 1, size2, 0);
+      }
+    }
+  }
+  if (rows.length > 256) {
+    throw new Error('code table has ' + rows.length + ' rows');
+  }
+  while (rows.length < 256) {
+    row(0, 0, 0, 0, 0, 0);
+  }
+  return rows;
+};
+
+/**
+ * @param {!Array<!Object<string, number>>} rows From buildCodeTable.
+ * @return {!Uint8Array} The code table string (RFC 3284 section 7): the
+ *     type1, type2, size1, size2, mode1 and mode2 columns.
+ */
+VcdiffWriter.codeTableString = function(rows) {
+  var str = new Uint8Array(6 * 256);
+  var columns = ['type1', 'type2', 'size1', 'size2', 'mode1', 'mode2'];
+  for (var c = 0; c < 6; c++) {
+    for (var i = 0; i < 256; i++) {
+      str[c * 256 + i] = rows[i][columns[c]];
+    }
+  }
+  return str;
+};
+
+/**
+ * Encodes a code table string as a delta against the string of the default
+ * table, which is how VCD_CODETABLE headers carry it.
+ * @param {!Uint8Array} str
+ * @return {!Uint8Array}
+ */
+VcdiffWriter.encodeCodeTable = function(str) {
+  var dflt = VcdiffWriter.codeTableString(
+      VcdiffWriter.buildCodeTable(VcdiffWriter.RFC3284_CODE_TABLE));
+  var writer = new VcdiffWriter(dflt);
+  var insts = [];
+  var i = 0;
+  while (i < str.length) {
+    var same = 0;
+    while (i + same < str.length && i + same < dflt.length &&
+           str[i + same] == dflt[i + same]) {
+      same++;
+    }
+    if (same >= 4) {
+      insts.push(['COPY', i, same]);
+      i += same;
+      continue;
+    }
+    var start = i;
+    i += Math.max(same, 1);
+    while (i < str.length && !(i + 4 <= dflt.length &&
+           str[i] == dflt[i] && str[i + 1] == dflt[i + 1] &&
+           str[i + 2] == dflt[i + 2] && str[i + 3] == dflt[i + 3])) {
+      i++;
+    }
+    insts.push(['ADD', str.subarray(start, i)]);
+  }
+  writer.addWindow(insts, VcdiffWriter.VCD_SOURCE, 0, dflt.length);
+  return writer.delta();
+};
+
+/**
+ * Encodes the windows added after this with an application code table
+ * (VCD_CODETABLE). Each instruction takes the cheapest address mode and,
+ * where the table has a row for it, shares an opcode with the next one.
+ * Must be called after setSecondary and before the first window.
+ * @param {!Array<!Object<string, number>>} rows From buildCodeTable.
+ * @param {number} near The size of the near cache.
+ * @param {number} same The size of the same cache.
+ */
+VcdiffWriter.prototype.setCodeTable = function(rows, near, same) {
+  if (this.targetParts.length) {
+    throw new Error('setCodeTable after a window');
+  }
+  var data = VcdiffWriter.encodeCodeTable(VcdiffWriter.codeTableString(rows));
+  this.bytes[4] |= 0x02;  // VCD_CODETABLE
+  VcdiffWriter.pushInteger(this.bytes, data.length + 2);
+  this.bytes.push(near, same);
+  for (var i = 0; i < data.length; i++) {
+    this.bytes.push(data[i]);
+  }
+
+  var opcodes = {};
+  for (var op = 255; op >= 0; op--) {
+    var r = rows[op];
+    opcodes[[r.type1, r.size1, r.mode1, r.type2, r.size2, r.mode2]] = op;
+  }
+  this.codeTable = {rows: rows, near: near, same: same, opcodes: opcodes};
+};
+
+/**
+ * Appends a window.
+ * @param {!Array<!Array>} insts The instructions.
+ * @param {number=} opt_win_ind VCD_SOURCE, VCD_TARGET and/or VCD_ADLER32.
+ * @param {number=} opt_cpyoff The copy window offset.
+ * @param {number=} opt_cpylen The copy window length.
+ */
+VcdiffWriter.prototype.addWindow = function(insts, opt_win_ind, opt_cpyoff,
+    opt_cpylen) {
+  var win_ind = opt_win_ind || 0;
+  var cpyoff = opt_cpyoff || 0;
+  var cpylen = opt_cpylen || 0;
+  var copyWindow = new Uint8Array(0);
+  if (win_ind & VcdiffWriter.VCD_SOURCE) {
+    copyWindow = this.source.subarray(cpyoff, cpyoff + cpylen);
+  } else if (win_ind & VcdiffWriter.VCD_TARGET) {
+    copyWindow = this.target().subarray(cpyoff, cpyoff + cpylen);
+  }
+
+  var data = [];
+  var inst = [];
+  var addr = [];
+  var target = [];
+  for (var i = 0; i < insts.length; i++) {
+    var op = insts[i];
+    var j;
+    switch (op[0]) {
+      case 'RUN':
+        inst.push(0);
+        VcdiffWriter.pushInteger(inst, op[2]);
+        data.push(op[1]);
+        for (j = 0; j < op[2]; j++) {
+          target.push(op[1]);
+        }
+        break;
+      case 'ADD':
+        if (op[1].length <= 17) {
+          inst.push(1 + op[1].length);
+        } else {
+          inst.push(1);
+          VcdiffWriter.pushInteger(inst, op[1].length);
+        }
+        for (j = 0; j < op[1].length; j++) {
+          data.push(op[1][j]);
+          target.push(op[1][j]);
+        }
+        break;
+      case 'COPY':
+        if (op[2] >= 4 && op[2] <= 18) {
+          inst.push(20 + op[2] - 4);
+        } else {
+          inst.push(19);
+          VcdiffWriter.pushInteger(inst, op[2]);
+        }
+        VcdiffWriter.pushInteger(addr, op[1]);
+        for (j = 0; j < op[2]; j++) {
+          var a = op[1] + j;
+          target.push(a < cpylen ? copyWindow[a] : target[a - cpylen]);
+        }
+        break;
+      default:
+        throw new Error('unknown instruction ' + op[0]);
+    }
+  }
+
+  if (this.codeTable) {
+    // The data section is the same with any code table.
+    var sections = this.encodeWithTable_(insts, cpylen);
+    inst = sections.inst;
+    addr = sections.addr;
+  }
+
+  var del_ind = 0;
+  if (this.secondary) {
+    del_ind = this.secondary.del_ind;
+    var sections = [data, inst, addr];
+    for (var s = 0; s < 3; s++) {
+      if (del_ind & (1 << s)) {
+        var comp = [];
+        VcdiffWriter.pushInteger(comp, sections[s].length);
+        sections[s] = comp.concat(this.secondary.compress(s, sections[s]));
+      }
+    }
+    data = sections[0];
+    inst = sections[1];
+    addr = sections[2];
+  }
+
+  var tail = [];
+  VcdiffWriter.pushInteger(tail, target.length);
+  tail.push(del_ind);  // delta indicator
+  VcdiffWriter.pushInteger(tail, data.length);
+  VcdiffWriter.pushInteger(tail, inst.length);
+  VcdiffWriter.pushInteger(tail, addr.length);
+  var targetBytes = new Uint8Array(target);
+  if (win_ind & VcdiffWriter.VCD_ADLER32) {
+    var a32 = VcdiffWriter.adler32(targetBytes);
+    tail.push(a32 >>> 24, (a32 >>> 16) & 0xff, (a32 >>> 8) & 0xff, a32 & 0xff);
+  }
+
+  var bytes = this.bytes;
+  bytes.push(win_ind);
+  if (win_ind & (VcdiffWriter.VCD_SOURCE | VcdiffWriter.VCD_TARGET)) {
+    VcdiffWriter.pushInteger(bytes, cpylen);
+    VcdiffWriter.pushInteger(bytes, cpyoff);
+  }
+  VcdiffWriter.pushInteger(bytes,
+      tail.length + data.length + inst.length + addr.length);
+  [tail, data, inst, addr].forEach(function(part) {
+    for (var k = 0; k < part.length; k++) {
+      bytes.push(part[k]);
+    }
+  });
+
+  this.targetParts.push(targetBytes);
+  this.targetLength += targetBytes.length;
+};
+
+/**
+ * Encodes the INST and ADDR sections of a window with this.codeTable.
+ * @param {!Array<!Array>} insts
+ * @param {number} cpylen
+ * @return {{inst: !Array<number>, addr: !Array<number>}}
+ * @private
+ */
+VcdiffWriter.prototype.encodeWithTable_ = function(insts, cpylen) {
+  var table = this.codeTable;
+  var nearArray = new Array(table.near).fill(0);
+  var sameArray = new Array(table.same * 256).fill(0);
+  var nextSlot = 0;
+  var here = cpylen;
+
+  // The half-instructions, with their addresses in the cheapest mode.
+  var halves = [];
+  for (var i = 0; i < insts.length; i++) {
+    var op = insts[i];
+    var half = {type: 0, size: 0, mode: 0, addr: []};
+    switch (op[0]) {
+      case 'RUN':
+        half.type = 2;
+        half.size = op[2];
+        break;
+      case 'ADD':
+        half.type = 1;
+        half.size = op[1].length;
+        break;
+      case 'COPY':
+        half.type = 3;
+        half.size = op[2];
+        var a = op[1];
+        var index = a % (table.same * 256);
+        if (table.same > 0 && sameArray[index] == a) {
+          half.mode = 2 + table.near + (index >> 8);
+          half.addr = [index & 0xff];
+        } else {
+          var candidates = [[0, a], [1, here - a]];
+          for (var n = 0; n < table.near; n++) {
+            if (a >= nearArray[n]) {
+              candidates.push([2 + n, a - nearArray[n]]);
+            }
+          }
+          for (var c = 0; c < candidates.length; c++) {
+            var bytes = [];
+            VcdiffWriter.pushInteger(bytes, candidates[c][1]);
+            if (c == 0 || bytes.length < half.addr.length) {
+              half.mode = candidates[c][0];
+              half.addr = bytes;
+            }
+          }
+        }
+        if (table.near > 0) {
+          nearArray[nextSlot] = a;
+          nextSlot = (nextSlot + 1) % table.near;
+        }
+        if (table.same > 0) {
+          sameArray[index] = a;
+        }
+        break;
+    }
+    here += half.size;
+    halves.push(half);
+  }
+
+  // Finds the opcode of one or two halves, preferring the table's sizes
+  // over sizes read from the INST section.
+  var lookup = function(h1, h2) {
+    var sizes1 = (h1.size < 256) ? [h1.size, 0] : [0];
+    var sizes2 = !h2 ? [0] : (h2.size < 256) ? [h2.size, 0] : [0];
+    for (var s1 = 0; s1 < sizes1.length; s1++) {
+      for (var s2 = 0; s2 < sizes2.length; s2++) {
+        var op = table.opcodes[[h1.type, sizes1[s1], h1.mode,
+                                h2 ? h2.type : 0, sizes2[s2],
+                                h2 ? h2.mode : 0]];
+        if (op !== undefined) {
+          return {op: op, size1: sizes1[s1], size2: sizes2[s2]};
+        }
+      }
+    }
+    return null;
+  };
+
+  var inst = [];
+  var addr = [];
+  for (var i = 0; i < halves.length; i++) {
+    var pair = (i + 1 < halves.length) ? [halves[i], halves[i + 1]] : null;
+    var found = pair && lookup(pair[0], pair[1]);
+    if (found) {
+      i++;
+    } else {
+      pair = [halves[i]];
+      found = lookup(halves[i], null);
+      if (!found) {
+        throw new Error('code table cannot encode ' + insts[i][0]);
+      }
+    }
+    inst.push(found.op);
+    if (found.size1 == 0) {
+      VcdiffWriter.pushInteger(inst, pair[0].size);
+    }
+    if (pair.length == 2 && found.size2 == 0) {
+      VcdiffWriter.pushInteger(inst, pair[1].size);
+    }
+    for (var h = 0; h < pair.length; h++) {
+      addr.push.apply(addr, pair[h].addr);
+    }
+  }
+  return {inst: inst, addr: addr};
+};
+
+/**
+ * @return {!Uint8Array} The delta.
+ */
+VcdiffWriter.prototype.delta = function() {
+  return new Uint8Array(this.bytes);
+};
+
+/**
+ * @return {!Uint8Array} The target the delta decodes to.
+ */
+VcdiffWriter.prototype.target = function() {
+  var target = new Uint8Array(this.targetLength);
+  var pos = 0;
+  for (var i = 0; i < this.targetParts.length; i++) {
+    target.set(this.targetParts[i], pos);
+    pos += this.targetParts[i].length;
+  }
+  return target;
+};
+
+/**
+ * Encodes a target without a source, copying repeated content from earlier
+ * windows with VCD_TARGET windows. This is the large checksum match of the
+ * XDelta3 encoder applied to the target: block-aligned checksums of the
+ * earlier target go in a hash table and each window is searched with a
+ * rolling checksum. A match is extended both ways. The copy window of a
+ * window spans its matches.
+ *
+ * Only the last opt_history bytes before a window are searched. Then the
+ * table needs opt_history / opt_block entries, and a decoder's
+ * decodeWindows needs the same opt_history. Without VCD_TARGET
+ * (opt_history 0) every window is one ADD.
+ *
+ * @param {!Uint8Array} target
+ * @param {{winsize: (number|undefined), history: (number|undefined),
+ *     block: (number|undefined)}=} opt_options The window size (default
+ *     64KB), the history (default 8MB) and the checksum block size (default
+ *     32).
+ * @return {!VcdiffWriter}
+ */
+VcdiffWriter.encodeTarget = function(target, opt_options) {
+  var options = opt_options || {};
+  var winsize = options.winsize || (1 << 16);
+  var history = (options.history === undefined) ? (1 << 23) : options.history;
+  var block = options.block || 32;
+
+  var bits = 1;
+  while ((1 << bits) < history / block) {
+    bits++;
+  }
+  var table = new Int32Array(1 << bits);
+  table.fill(-1);
+  var shift = 32 - bits;
+  // The rolling checksum is a polynomial in BASE, mod 2^32.
+  var BASE = 0x01000193;
+  var basePow = 1;
+  for (var i = 0; i < block; i++) {
+    basePow = Math.imul(basePow, BASE);
+  }
+  var checksum = function(pos) {
+    var h = 0;
+    for (var i = 0; i < block; i++) {
+      h = (Math.imul(h, BASE) + target[pos + i]) | 0;
+    }
+    return h;
+  };
+
+  var writer = new VcdiffWriter();
+  for (var ws = 0; ws < target.length; ws += winsize) {
+    var we = Math.min(ws + winsize, target.length);
+    var lo = Math.max(0, ws - history);
+    var insts = [];
+    var matches = [];
+    var addStart = ws;
+    var p = ws;
+    var h = (history > 0 && p + block <= we) ? checksum(p) : 0;
+
+    while (history > 0 && p + block <= we) {
+      var c = table[Math.imul(h, 0x9E3779B1) >>> shift];
+      var len = 0;
+      if (c >= lo && c + block <= ws) {
+        while (p + len < we && c + len < ws && target[c + len] == target[p + len]) {
+          len++;
+        }
+      }
+      if (len >= block) {
+        var back = 0;
+        while (p - back > addStart && c - back > lo &&
+               target[c - back - 1] == target[p - back - 1]) {
+          back++;
+        }
+        if (p - back > addStart) {
+          insts.push(['ADD', target.subarray(addStart, p - back)]);
+        }
+        insts.push(['COPY', c - back, len + back]);
+        matches.push(insts.length - 1);
+        p += len;
+        addStart = p;
+        if (p + block <= we) {
+          h = checksum(p);
+        }
+        continue;
+      }
+      if (p + block < we) {
+        h = (Math.imul(h, BASE) + target[p + block] -
+             Math.imul(target[p], basePow)) | 0;
+      }
+      p++;
+    }
+    if (addStart < we) {
+      insts.push(['ADD', target.subarray(addStart, we)]);
+    }
+
+    // Index the window's blocks for the windows that follow.
+    for (var pos = ws; history > 0 && pos + block <= we; pos += block) {
+      table[Math.imul(checksum(pos), 0x9E3779B1) >>> shift] = pos;
+    }
+
+    if (matches.length == 0) {
+      writer.addWindow(insts);
+      continue;
+    }
+    var cpyoff = ws;
+    var cpyend = 0;
+    for (var i = 0; i < matches.length; i++) {
+      var op = insts[matches[i]];
+      cpyoff = Math.min(cpyoff, op[1]);
+      cpyend = Math.max(cpyend, op[1] + op[2]);
+    }
+    for (var i = 0; i < matches.length; i++) {
+      insts[matches[i]][1] -= cpyoff;
+    }
+    writer.addWindow(insts, VcdiffWriter.VCD_TARGET, cpyoff, cpyend - cpyoff);
+  }
+  return writer;
+};
+
+/**
+ * Returns the delta with the sections of its windows compressed with a
+ * secondary compressor, like VcdiffWriter.setSecondary. The delta must not
+ * have secondary compression already. Empty sections are left as they are,
+ * as the C encoder does.
+ * @param {!Uint8Array} delta
+ * @param {number} id The secondary compressor ID.
+ * @param {function(number, !Array<number>): !Array<number>} compress
+ * @param {number=} opt_del_ind The sections to compress, default all.
+ * @return {!Uint8Array}
+ */
+VcdiffWriter.recompress = function(delta, id, compress, opt_del_ind) {
+  var sections = (opt_del_ind === undefined) ? 7 : opt_del_ind;
+  var pos = 0;
+  var getInteger = function() {
+    var val = 0;
+    var b;
+    do {
+      b = delta[pos++];
+      val = val * 128 + (b & 0x7f);
+    } while (b & 0x80);
+    return val;
+  };
+  var hdr_ind = delta[4];
+  if (hdr_ind & 0x01) {
+    throw new Error('recompress of a delta with secondary compression');
+  }
+  var bytes = Array.prototype.slice.call(delta, 0, 5);
+  bytes[4] |= 0x01;  // VCD_SECONDARY
+  bytes.push(id);
+  pos = 5;
+  // The code table and the application header are kept as they are.
+  for (var flag = 0x02; flag <= 0x04; flag <<= 1) {
+    if (hdr_ind & flag) {
+      var len = getInteger();
+      pos += len;
+    }
+  }
+  bytes = bytes.concat(Array.prototype.slice.call(delta, 5, pos));
+
+  while (pos < delta.length) {
+    var win = [];
+    var start = pos;
+    var win_ind = delta[pos++];
+    if (win_ind & (VcdiffWriter.VCD_SOURCE | VcdiffWriter.VCD_TARGET)) {
+      getInteger();
+      getInteger();
+    }
+    win = win.concat(Array.prototype.slice.call(delta, start, pos));
+    getInteger();  // The length of the delta encoding.
+    var tail = [];
+    VcdiffWriter.pushInteger(tail, getInteger());
+    if (delta[pos++] != 0) {
+      throw new Error('recompress of a delta with secondary compression');
+    }
+    var lengths = [getInteger(), getInteger(), getInteger()];
+    if (win_ind & VcdiffWriter.VCD_ADLER32) {
+      pos += 4;
+    }
+    var checksum = (win_ind & VcdiffWriter.VCD_ADLER32) ?
+        Array.prototype.slice.call(delta, pos - 4, pos) : [];
+    var del_ind = 0;
+    var parts = [];
+    for (var s = 0; s < 3; s++) {
+      var part = Array.prototype.slice.call(delta, pos, pos + lengths[s]);
+      pos += lengths[s];
+      if ((sections & (1 << s)) && part.length) {
+        var comp = [];
+        VcdiffWriter.pushInteger(comp, part.length);
+        part = comp.concat(compress(s, part));
+        del_ind |= 1 << s;
+      }
+      parts.push(part);
+    }
+    tail.push(del_ind);
+    for (var s = 0; s < 3; s++) {
+      VcdiffWriter.pushInteger(tail, parts[s].length);
+    }
+    tail = tail.concat(checksum, parts[0], parts[1], parts[2]);
+    VcdiffWriter.pushInteger(win, tail.length);
+    bytes = bytes.concat(win, tail);
+  }
+  return new Uint8Array(bytes);
+};
+
+/**
+ * Appends a VCDIFF variable length integer.
+ * @param {!Array<number>} bytes
+ * @param {number} val
+ */
+VcdiffWriter.pushInteger = function(bytes, val) {
+  var digits = [val % 128];
+  val = Math.floor(val / 128);
+  while (val > 0) {
+    digits.unshift(0x80 | (val % 128));
+    val = Math.floor(val / 128);
+  }
+  for (var i = 0; i < digits.length; i++) {
+    bytes.push(digits[i]);
+  }
+};
+
+/**
+ * The reference Adler32 checksum, one byte and one modulo at a time.
+ * @param {!Uint8Array} bytes
+ * @return {number}
+ */
+VcdiffWriter.adler32 = function(bytes) {
+  var s1 = 1;
+  var s2 = 0;
+  for (var i = 0; i < bytes.length; i++) {
+    s1 = (s1 + bytes[i]) % 65521;
+    s2 = (s2 + s1) % 65521;
+  }
+  return ((s2 << 16) | s1) >>> 0;
+};
+
+/**
+ * A backup-like target: 4KB files picked from a pool, each with one byte
+ * changed.
+ * @param {number} len
+ * @param {number=} opt_files The size of the pool, default 256.
+ * @return {!Uint8Array}
+ */
+VcdiffWriter.backupBytes = function(len, opt_files) {
+  var files = [];
+  for (var i = 0; i < (opt_files || 256); i++) {
+    files.push(VcdiffWriter.randomBytes(4096, i + 1));
+  }
+  var bytes = new Uint8Array(len);
+  var x = 1;
+  for (var pos = 0; pos < len; pos += 4096) {
+    x = (x * 1103515245 + 12345) & 0x7fffffff;
+    var file = files[(x >> 8) % files.length].slice();
+    file[x % 4096] ^= 1;
+    bytes.set(file.subarray(0, Math.min(4096, len - pos)), pos);
+  }
+  return bytes;
+};
+
+/**
+ * @param {number} len
+ * @param {number=} opt_seed
+ * @return {!Uint8Array} Pseudo-random bytes.
+ */
+VcdiffWriter.randomBytes = function(len, opt_seed) {
+  var bytes = new Uint8Array(len);
+  var x = opt_seed || 1;
+  for (var i = 0; i < len; i++) {
+    x = (x * 1103515245 + 12345) & 0x7fffffff;
+    bytes[i] = x >>> 16;
+  }
+  return bytes;
+};
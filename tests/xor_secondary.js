@@ -0,0 +1,26 @@
+/**
+ * A test secondary compressor that XORs each section with a running key.
+ * The key carries over from window to window, like the state of LZMA, so
+ * its sections are not independent.
+ *
+ * A page loads it after ../xdelta3_decoder.js; xor_worker.js loads both in
+ * the decodeParallel workers.
+ */
+var XOR_ID = 200;
+
+XDelta3Decoder.registerSecondary({
+  id: XOR_ID,
+  name: 'XOR',
+  alloc: function() {
+    return {key: 0};
+  },
+  decode: function(state, input, output) {
+    if (input.length != output.length) {
+      throw new Error('secondary decoder finished with unused input');
+    }
+    for (var i = 0; i < input.length; i++) {
+      output[i] = input[i] ^ (state.key++ & 0xff);
+    }
+    return input.length;
+  }
+});
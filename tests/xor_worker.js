@@ -0,0 +1,4 @@
+/**
+ * The workerUrl of decodeParallel for deltas compressed with XOR_ID.
+ */
+importScripts('../xdelta3_decoder.js', 'xor_secondary.js');
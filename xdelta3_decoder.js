@@ -41,7 +41,7 @@
  * This code is a port and follows that code style.
  */
 
-(function() {
+(function(window) {
 
   // Check for namespace collision.
   if ((typeof window['XDelta3Decoder'] != 'undefined')
@@ -57,21 +57,574 @@
 
   var XDelta3Decoder = window.XDelta3Decoder;
 
+  /**
+   * Decoder flags, with the values of the C xd3_flags.
+   */
+  /**
+   * Skip the VCD_ADLER32 target window checksum verification.
+   * @type {number}
+   */
+  XDelta3Decoder.XD3_ADLER32_NOVER = (1 << 11);
+
+  /**
+   * A source that is read a block at a time, like the getblk callback of the
+   * C code. getblk(blkno) returns the bytes from blkno * blksize, which are
+   * blksize bytes long except in the last block.
+   *
+   * The decoder keeps the max_blocks (default 16) most recently used blocks
+   * and only calls getblk for others. It counts the block lookups it served
+   * from the cache in hits and the block reads in misses.
+   *
+   * decodeAsync calls getblkAsync instead, for all of the blocks a window
+   * copies from before it produces the window. A Source for decodeAsync
+   * only needs getblkAsync.
+   * @typedef {{size: number, blksize: number,
+   *     getblk: (function(number): !Uint8Array|undefined),
+   *     getblkAsync: (function(number): !Promise<!Uint8Array>|undefined),
+   *     max_blocks: (number|undefined), hits: (number|undefined),
+   *     misses: (number|undefined)}}
+   */
+  XDelta3Decoder.Source;
+
+  /**
+   * The public API to use a File or Blob as the source without reading all
+   * of it into memory. Each block is read when the first copy from it is
+   * decoded. decode reads with FileReaderSync, which only exists in
+   * workers; decodeAsync reads with Blob.arrayBuffer anywhere.
+   * decodeParallel passes it to its workers.
+   * @param {!Blob} file
+   * @param {number=} opt_blksize The block size (optional).
+   * @param {number=} opt_max_blocks The number of blocks to cache (optional).
+   * @return {!XDelta3Decoder.Source}
+   */
+  XDelta3Decoder.fileSource = function(file, opt_blksize, opt_max_blocks) {
+    var blksize = opt_blksize || XD3_DEFAULT_SRCBLKSZ;
+    var reader = null;
+    return {
+      size: file.size,
+      blksize: blksize,
+      max_blocks: opt_max_blocks,
+      file: file,
+      getblk: function(blkno) {
+        if (!reader) {
+          if (typeof FileReaderSync == 'undefined') {
+            throw new Error('fileSource can only be read in a worker');
+          }
+          reader = new FileReaderSync();
+        }
+        var start = blkno * blksize;
+        return new Uint8Array(
+            reader.readAsArrayBuffer(file.slice(start, start + blksize)));
+      },
+      getblkAsync: function(blkno) {
+        var start = blkno * blksize;
+        return file.slice(start, start + blksize).arrayBuffer().then(
+            function(buffer) {
+              return new Uint8Array(buffer);
+            });
+      }
+    };
+  }
+
   /**
    * The public API to decode a delta possibly with a source.
    * @param {!Uint8Array} delta The Xdelta delta file.
-   * @param {Uint8Array=} opt_source The source file (optional).
+   * @param {(Uint8Array|XDelta3Decoder.Source)=} opt_source The source file
+   *     (optional).
+   * @param {number=} opt_flags XDelta3Decoder.XD3_* flags (optional).
+   * @param {xd3_arena=} opt_arena From createArena (optional).
    * @return {!ArrayBuffer}
    */
-  XDelta3Decoder.decode = function(delta, opt_source) {
+  XDelta3Decoder.decode = function(delta, opt_source, opt_flags, opt_arena) {
     if (typeof opt_source != 'object') {
       opt_source = null;
     }
-    var xdelta3 = new _XDelta3Decoder(delta, opt_source);
+    var xdelta3 = new _XDelta3Decoder(delta, opt_source, opt_flags);
+    xdelta3.xd3_set_arena(opt_arena);
     var uint8Bytes = xdelta3.xd3_decode_input();
     return uint8Bytes.buffer;
   }
 
+  /**
+   * The public API to create an arena for decode and decodeInto. The
+   * decoder's buffers for the window sections, checksums and code table are
+   * taken from one region instead of being allocated for each window, which
+   * saves the allocations when decoding many small deltas. The region is
+   * sized from the first window header (or opt_size) and grows to the
+   * largest window. Each decode starts by giving back everything the
+   * previous one took, so an arena is for one decode at a time.
+   * @param {number=} opt_size The initial size in bytes (optional).
+   * @return {!xd3_arena}
+   */
+  XDelta3Decoder.createArena = function(opt_size) {
+    return new xd3_arena(opt_size ? xd3_round_alloc(opt_size) : 0);
+  }
+
+  /**
+   * A delta of a batch and where its target goes, see decodeBatch. Without
+   * an output the target is decoded into a new buffer.
+   * @typedef {{delta: !Uint8Array, output: (Uint8Array|undefined)}}
+   */
+  XDelta3Decoder.BatchItem;
+
+  /**
+   * What decodeBatch reports: for each item its target (a view of the
+   * item's output or a new buffer, null if it failed), the target length
+   * and the error message if it failed; the number of items that failed;
+   * and the target bytes, milliseconds and MB/s of the whole batch.
+   * @typedef {{results: !Array<{target: ?Uint8Array, length: number,
+   *     error: ?string}>, failed: number, bytes: number, millis: number,
+   *     mbPerSec: number}}
+   */
+  XDelta3Decoder.BatchResult;
+
+  /**
+   * The public API to decode many deltas against one source. The deltas
+   * are decoded one after another by one decoder, which is reset rather
+   * than set up again for each, see createPool, and which keeps the source
+   * blocks it cached. A delta that fails does not stop the others.
+   * @param {(Uint8Array|XDelta3Decoder.Source)} source The source file or
+   *     null.
+   * @param {!Array<!XDelta3Decoder.BatchItem>} items
+   * @param {number=} opt_flags XDelta3Decoder.XD3_* flags (optional).
+   * @return {!XDelta3Decoder.BatchResult}
+   */
+  XDelta3Decoder.decodeBatch = function(source, items, opt_flags) {
+    var startTime = xd3_now();
+    var pool = new xd3_stream_pool(1);
+    var results = items.map(function(item) {
+      return xd3_batch_decode(pool, source, item.delta, item.output || null,
+          opt_flags);
+    });
+    return xd3_batch_report(results, xd3_now() - startTime);
+  }
+
+  /**
+   * The public API to decode many deltas against one source with a pool of
+   * Web Workers. The items are split into one contiguous run per worker
+   * with about the same delta bytes, and each worker decodes its run like
+   * decodeBatch. The source is passed to the workers as by decodeParallel.
+   * The targets are copied into the items' outputs. A batch of one item, a
+   * Source other than fileSource, or a page without Worker is decoded on
+   * the calling thread.
+   * @param {(Uint8Array|XDelta3Decoder.Source)} source The source file or
+   *     null.
+   * @param {!Array<!XDelta3Decoder.BatchItem>} items
+   * @param {{workerUrl: (string|undefined), workers: (number|undefined),
+   *     flags: (number|undefined)}=} opt_options As for decodeParallel.
+   * @return {!Promise<!XDelta3Decoder.BatchResult>}
+   */
+  XDelta3Decoder.decodeBatchParallel = function(source, items, opt_options) {
+    return new Promise(function(resolve, reject) {
+      var options = opt_options || {};
+      var workers = Math.min(items.length, options.workers ||
+          (typeof navigator != 'undefined' && navigator.hardwareConcurrency) ||
+          1);
+      var portable = !source || source instanceof Uint8Array || source.file;
+      if (!options.workerUrl || typeof Worker == 'undefined' || !portable ||
+          workers < 2) {
+        resolve(XDelta3Decoder.decodeBatch(source, items, options.flags));
+        return;
+      }
+      xd3_batch_workers(source, items, options, workers, resolve, reject);
+    });
+  }
+
+  /**
+   * The public API to decode a delta into a buffer the caller owns, such as
+   * a view of a larger buffer, without another copy of the target.
+   * @param {!Uint8Array} delta The Xdelta delta file.
+   * @param {(Uint8Array|XDelta3Decoder.Source)} source The source file or
+   *     null.
+   * @param {!Uint8Array} output At least as long as the target, which is
+   *     written from its start.
+   * @param {number=} opt_flags XDelta3Decoder.XD3_* flags (optional).
+   * @param {xd3_arena=} opt_arena From createArena (optional).
+   * @return {number} The length of the target.
+   */
+  XDelta3Decoder.decodeInto = function(delta, source, output, opt_flags,
+      opt_arena) {
+    var xdelta3 = new _XDelta3Decoder(delta, source, opt_flags);
+    xdelta3.xd3_set_arena(opt_arena);
+    return xdelta3.xd3_decode_into(output);
+  }
+
+  /**
+   * The public API to create a pool of decoders for decoding many deltas,
+   * such as many small deltas against the same source. The decode and
+   * decodeInto methods of the pool work like XDelta3Decoder.decode and
+   * decodeInto, but take a decoder from the pool and put it back after, so
+   * its address caches, instruction list and arena are reused rather than
+   * allocated for every delta. A decoder given the same source as last time
+   * also keeps the source blocks it cached, so a Source object should not
+   * be reused for different bytes. A pool may be used from the getblk
+   * callback of one of its own decodes; that decode's decoder is not in the
+   * pool until it is done. Workers have their own pools.
+   * @param {number=} opt_max The most decoders to keep (optional, default
+   *     4).
+   * @return {!xd3_stream_pool}
+   */
+  XDelta3Decoder.createPool = function(opt_max) {
+    return new xd3_stream_pool(opt_max || XD3_DEFAULT_POOL_STREAMS);
+  }
+
+  /**
+   * The public API to decode a delta a window at a time into buffers the
+   * caller provides. getwin(winno, offset, length) is called before each
+   * window is produced and returns where the window goes: a buffer of at
+   * least length bytes, whose first length bytes will be the target at
+   * offset. It may return the same buffer every time once the previous
+   * window is consumed.
+   *
+   * Since earlier windows may be gone, the last opt_history bytes of the
+   * target (default 8MB) are kept for VCD_TARGET windows, which fail if
+   * they copy from before that. This is the only memory the decoder keeps
+   * between windows besides the source cache.
+   * @param {!Uint8Array} delta The Xdelta delta file.
+   * @param {(Uint8Array|XDelta3Decoder.Source)} source The source file or
+   *     null.
+   * @param {function(number, number, number): !Uint8Array} getwin
+   * @param {number=} opt_flags XDelta3Decoder.XD3_* flags (optional).
+   * @param {number=} opt_history The VCD_TARGET history size (optional, 0
+   *     for none).
+   * @return {number} The length of the target.
+   */
+  XDelta3Decoder.decodeWindows = function(delta, source, getwin, opt_flags,
+      opt_history) {
+    var xdelta3 = new _XDelta3Decoder(delta, source, opt_flags);
+    xdelta3.xd3_decode_header();
+    xdelta3.dec_getwin = getwin;
+    xdelta3.dec_history = new xd3_history(
+        (opt_history === undefined) ? XD3_DEFAULT_HISTORY : opt_history);
+    xdelta3.xd3_decode_windows(null);
+    return xdelta3.dec_winstart + xdelta3.dec_tgtlen;
+  }
+
+  /**
+   * The public API to decode a delta with a source that is read
+   * asynchronously. Each window's instructions are decoded first, then all
+   * of the source blocks the window copies from are requested at once with
+   * getblkAsync, so the reads overlap rather than wait on each other.
+   * @param {!Uint8Array} delta The Xdelta delta file.
+   * @param {(Uint8Array|XDelta3Decoder.Source)=} opt_source The source file
+   *     (optional).
+   * @param {number=} opt_flags XDelta3Decoder.XD3_* flags (optional).
+   * @return {!Promise<!ArrayBuffer>}
+   */
+  XDelta3Decoder.decodeAsync = function(delta, opt_source, opt_flags) {
+    return new Promise(function(resolve) {
+      var source = (typeof opt_source == 'object') ? opt_source : null;
+      var xdelta3 = new _XDelta3Decoder(delta, source, opt_flags);
+      xdelta3.xd3_decode_header();
+      var wins = xdelta3.xd3_scan_windows();
+      resolve(xdelta3.xd3_decode_windows_async(
+          new Uint8Array(wins.tgt_pos[wins.count])));
+    }).then(function(output) {
+      return output.buffer;
+    });
+  }
+
+  /**
+   * The public API to decode a delta with a pool of Web Workers.
+   *
+   * Windows that copy only from the source and from their own target window
+   * do not depend on each other. The window boundaries are found with a
+   * header scan, the windows are split into one contiguous run per worker
+   * and each worker decodes its run into its part of the output. When
+   * SharedArrayBuffer is available (a cross-origin isolated page) the
+   * source is shared and the workers write the output in place; otherwise
+   * each worker's part is copied into the output once.
+   *
+   * Deltas with a single window, with VCD_TARGET windows, with a secondary
+   * compressor that is not independent, or in a page without Worker are
+   * decoded on the calling thread. If their sections are secondary
+   * compressed, workers decompress the DATA, INST and ADDR sections
+   * concurrently, each in window order, while the calling thread executes
+   * the windows whose sections are done. That falls back to the calling
+   * thread too when the workers do not know the compressor.
+   * @param {!Uint8Array} delta The Xdelta delta file.
+   * @param {(Uint8Array|XDelta3Decoder.Source)=} opt_source The source file
+   *     (optional). A Source other than fileSource is only read on the
+   *     calling thread.
+   * @param {{workerUrl: (string|undefined), workers: (number|undefined),
+   *     flags: (number|undefined)}=} opt_options The URL of this script,
+   *     which the workers load, the number of workers (the default is
+   *     navigator.hardwareConcurrency) and the XDelta3Decoder.XD3_* flags.
+   * @return {!Promise<!ArrayBuffer|!SharedArrayBuffer>}
+   */
+  XDelta3Decoder.decodeParallel = function(delta, opt_source, opt_options) {
+    return new Promise(function(resolve, reject) {
+      var options = opt_options || {};
+      var source = (typeof opt_source == 'object') ? opt_source : null;
+      var xdelta3 = new _XDelta3Decoder(delta, source, options.flags);
+      xdelta3.xd3_decode_header();
+      var wins = xdelta3.xd3_scan_windows();
+      var workers = options.workers ||
+          (typeof navigator != 'undefined' && navigator.hardwareConcurrency) ||
+          1;
+      var portable = !source || source instanceof Uint8Array || source.file;
+      var independent = !xdelta3.sec_type || xdelta3.sec_type.independent;
+      var groups = (options.workerUrl && typeof Worker != 'undefined' &&
+                    portable && independent) ?
+          xd3_split_windows(wins, workers) : [0, wins.count];
+
+      if (groups.length <= 2) {
+        if (xdelta3.sec_type && options.workerUrl &&
+            typeof Worker != 'undefined') {
+          xd3_decode_section_workers(xdelta3, wins, workers,
+              options.workerUrl, function() {
+                return XDelta3Decoder.decode(delta, source, options.flags);
+              }, resolve, reject);
+        } else {
+          resolve(xdelta3.xd3_decode_windows(
+              new Uint8Array(wins.tgt_pos[wins.count])).buffer);
+        }
+        return;
+      }
+      xd3_decode_workers(delta, source, options, wins, groups, resolve, reject);
+    });
+  }
+
+  /**
+   * The public API to apply a chain of deltas, each made from the target of
+   * the one before it, with one Web Worker per delta. Each worker passes the
+   * windows of its target on to the next delta's worker, which reads them
+   * as its source. So all of the deltas are decoded at once rather than one
+   * after another.
+   *
+   * An intermediate window is dropped once no later window of the next
+   * delta copies from it, going by the copy windows of the next delta, and
+   * a worker stops when the next worker holds options.ahead bytes (default
+   * 8MB) of its target, unless that worker waits for a window. So the
+   * memory of a chain is about options.ahead bytes for each delta plus what
+   * its copy windows still reach, rather than every intermediate target.
+   * A delta whose copy windows reach back to the start of its source still
+   * keeps the whole source; see compose to do without them.
+   *
+   * Without Worker, with a Source other than fileSource, or with a single
+   * delta, the deltas are decoded one after another on the calling thread.
+   * @param {(Uint8Array|XDelta3Decoder.Source)} source The source of the
+   *     first delta or null.
+   * @param {!Array<!Uint8Array>} deltas
+   * @param {{workerUrl: (string|undefined), flags: (number|undefined),
+   *     ahead: (number|undefined), stats: (!Array<!Object>|undefined)}=}
+   *     opt_options The URL of this script, which the workers load, the
+   *     XDelta3Decoder.XD3_* flags, the bytes a worker may make ahead of
+   *     the next one, and an array that gets the source block hits and
+   *     misses of each worker, the windows it dropped and how many of those
+   *     its source cache still held, which should be 0.
+   * @return {!Promise<!ArrayBuffer>} The target of the last delta.
+   */
+  XDelta3Decoder.decodeChain = function(source, deltas, opt_options) {
+    return new Promise(function(resolve, reject) {
+      var options = opt_options || {};
+      if (deltas.length == 0) {
+        throw new Error('no deltas to apply');
+      }
+      var portable = !source || source instanceof Uint8Array || source.file;
+      if (!options.workerUrl || typeof Worker == 'undefined' || !portable ||
+          deltas.length == 1) {
+        var target = source;
+        for (var i = 0; i < deltas.length; i++) {
+          target = new Uint8Array(
+              XDelta3Decoder.decode(deltas[i], target, options.flags));
+        }
+        resolve(target.buffer);
+        return;
+      }
+      xd3_decode_chain_workers(source, deltas, options, resolve, reject);
+    });
+  }
+
+  /**
+   * The public API to build a window index of a delta. The index maps target
+   * offsets to windows and can be saved next to the delta to skip the scan
+   * in decodeRange. It is found by reading only the window headers.
+   * @param {!Uint8Array} delta The Xdelta delta file.
+   * @return {!Uint8Array} The index, see xd3_write_index.
+   */
+  XDelta3Decoder.buildIndex = function(delta) {
+    var xdelta3 = new _XDelta3Decoder(delta, null);
+    xdelta3.xd3_decode_header();
+    return xd3_write_index(xdelta3.xd3_scan_windows(), delta.length);
+  }
+
+  /**
+   * The public API to decode a range of the target. Only the windows that
+   * overlap the range are decoded.
+   * @param {!Uint8Array} delta The Xdelta delta file.
+   * @param {Uint8Array|XDelta3Decoder.Source} source The source file or
+   *     null.
+   * @param {number} offset Where the range starts in the target.
+   * @param {number} length The length of the range.
+   * @param {Uint8Array=} opt_index From buildIndex (optional, the delta is
+   *     scanned without it).
+   * @param {number=} opt_flags XDelta3Decoder.XD3_* flags (optional).
+   * @return {!ArrayBuffer}
+   */
+  XDelta3Decoder.decodeRange = function(delta, source, offset, length,
+      opt_index, opt_flags) {
+    var xdelta3 = new _XDelta3Decoder(delta, source, opt_flags);
+    xdelta3.xd3_decode_header();
+    var wins = opt_index ? xd3_read_index(opt_index, delta.length) :
+        xdelta3.xd3_scan_windows();
+    var range = xdelta3.xd3_decode_range(wins, offset, length);
+    if (range.length != range.buffer.byteLength) {
+      range = range.slice();
+    }
+    return range.buffer;
+  }
+
+  /**
+   * The public API to compose two consecutive deltas into one: deltaAB
+   * makes B from A and deltaBC makes C from B, and the result makes C from
+   * A. B is never produced. Each copy of deltaBC from B is replaced by the
+   * copies from A and the data that deltaAB makes that part of B from. The
+   * result has the windows of deltaBC with the same target lengths and
+   * checksums, the default code table and no secondary compression.
+   * @param {!Uint8Array} deltaAB The A to B delta.
+   * @param {!Uint8Array} deltaBC The B to C delta.
+   * @return {!Uint8Array} The A to C delta.
+   */
+  XDelta3Decoder.compose = function(deltaAB, deltaBC) {
+    var bmap = new xd3_piecemap();
+    var ab = new _XDelta3Decoder(deltaAB,
+        xd3_unread_source(Number.MAX_SAFE_INTEGER));
+    ab.xd3_decode_header();
+    ab.xd3_walk_windows(function() {
+      xd3_compose_window(ab, null, bmap, null);
+    });
+
+    var bc = new _XDelta3Decoder(deltaBC, xd3_unread_source(bmap.end));
+    bc.xd3_decode_header();
+    /* VCD_TARGET windows copy from earlier in C, which is resolved to
+     * pieces of A too. */
+    var wins = bc.xd3_scan_windows();
+    var cmap = null;
+    for (var i = 0; i < wins.count; i++) {
+      if (wins.win_ind[i] & VCD_TARGET) {
+        cmap = new xd3_piecemap();
+      }
+    }
+    var bytes = [0xD6, 0xC3, 0xC4, 0, 0];
+    bc.xd3_walk_windows(function() {
+      var win = new xd3_piecemap();
+      xd3_compose_window(bc, bmap, cmap, win);
+      xd3_emit_window(bytes, win,
+          (bc.dec_win_ind & VCD_ADLER32) ? bc.dec_adler32 : null);
+    });
+    return new Uint8Array(bytes);
+  }
+
+  /**
+   * Statistics of a delta, or of one of its windows, from analyze. The
+   * copy distances are histograms where entry i counts the copies whose
+   * distance d has 2^i <= d < 2^(i+1), entry 0 also counting d = 0. A target
+   * copy's distance is how far back its bytes are; a source copy's is how far
+   * its source offset is from its target offset. The address modes count
+   * the copies of each mode: VCD_SELF, VCD_HERE, then each near and same
+   * cache mode. A section's stored size is its size in the delta, less than
+   * its size when it is secondary compressed.
+   * @typedef {{target: number, delta: number,
+   *     run: {count: number, bytes: number},
+   *     add: {count: number, bytes: number},
+   *     sourceCopy: {count: number, bytes: number},
+   *     targetCopy: {count: number, bytes: number},
+   *     sourceDistance: !Array<number>, targetDistance: !Array<number>,
+   *     modes: {self: number, here: number, near: !Array<number>,
+   *         same: !Array<number>},
+   *     sections: {data: {size: number, stored: number},
+   *         inst: {size: number, stored: number},
+   *         addr: {size: number, stored: number}}}}
+   */
+  XDelta3Decoder.DeltaStats;
+
+  /**
+   * The public API to summarize what a delta is made of without decoding
+   * it. The instructions of each window are decoded, with the secondary
+   * compressed sections decompressed, but no target is produced and the
+   * source is not read, so copies past the end of the source and checksum
+   * mismatches are not found. The result is ready for JSON.stringify.
+   * @param {!Uint8Array} delta
+   * @return {{secondary: ?string, codeTable: boolean,
+   *     windows: !Array<!XDelta3Decoder.DeltaStats>,
+   *     total: !XDelta3Decoder.DeltaStats}} The secondary compressor's name,
+   *     whether the delta has its own code table, and the statistics of each
+   *     window and of all of them.
+   */
+  XDelta3Decoder.analyze = function(delta) {
+    var xdelta3 = new _XDelta3Decoder(delta,
+        xd3_unread_source(Number.MAX_SAFE_INTEGER));
+    xdelta3.xd3_decode_header();
+    var acache = xdelta3.acache;
+    var total = new xd3_delta_stats(acache);
+    var windows = [];
+    xdelta3.dec_modes = new Float64Array(2 + acache.s_near + acache.s_same);
+    xdelta3.xd3_decode_address = xd3_decode_address_counted;
+    var start = xdelta3.position;
+    xdelta3.xd3_walk_windows(function() {
+      var stats = new xd3_delta_stats(acache);
+      xd3_window_stats(xdelta3, stats, xdelta3.position - start);
+      start = xdelta3.position;
+      xd3_add_stats(total, stats);
+      windows.push(stats);
+    });
+    return {
+      secondary: xdelta3.sec_type ? xdelta3.sec_type.name : null,
+      codeTable: (xdelta3.dec_hdr_ind & VCD_CODETABLE) != 0,
+      windows: windows,
+      total: total
+    };
+  }
+
+  /**
+   * The public API to compute the Adler32 checksum used by VCD_ADLER32.
+   * @param {!Uint8Array} bytes
+   * @return {number}
+   */
+  XDelta3Decoder.adler32 = function(bytes) {
+    return adler32(1, bytes, 0, bytes.length) >>> 0;
+  }
+
+  /**
+   * A secondary compressor of the VCDIFF sections, like the C xd3_sec_type.
+   * alloc() returns the state of one section type (data, inst or addr),
+   * which is kept from window to window like the C sec_stream. decode(state,
+   * input, output) decompresses a window's section into output, which is as
+   * long as the size the section declares, and returns how many bytes it
+   * wrote. It throws if input is not all used.
+   *
+   * If independent is set, each section decodes without the state left by
+   * earlier windows, so decodeParallel and decodeRange may skip windows.
+   * @typedef {{id: number, name: string, alloc: function(): *,
+   *     decode: function(*, !Uint8Array, !Uint8Array): number,
+   *     independent: (boolean|undefined)}}
+   */
+  XDelta3Decoder.SecondaryType;
+
+  /**
+   * The public API to add a secondary compressor. Deltas with its ID in the
+   * header can then be decoded. decodeParallel workers only know the
+   * compressors registered by the workerUrl script.
+   * @param {!XDelta3Decoder.SecondaryType} type
+   */
+  XDelta3Decoder.registerSecondary = function(type) {
+    xd3_sec_types[type.id] = type;
+  }
+
+  /**
+   * The public API to add a zstd dictionary, as made by zstd --train, for
+   * the deltas whose zstd (secondary compressor ID 3) frames name it.
+   * decodeParallel passes it to its workers.
+   * @param {!Uint8Array} dict
+   * @return {number} The dictionary ID.
+   */
+  XDelta3Decoder.addZstdDictionary = function(dict) {
+    var zdict = xd3_zstd_read_dict(dict);
+    xd3_zstd_dicts[zdict.id] = zdict;
+    return zdict.id;
+  }
+
   /**
    * The public API to disable debug printf code.
    */
@@ -90,6 +643,17 @@
   /** @type {number} */
   var XD3_CPY = 3;
 
+  /**
+   * The copy types of a decoded window instruction (see xd3_winops).  RUN and
+   * ADD keep their XD3 types.
+   */
+  /** @type {number} */
+  var XD3_SRCCPY = 3;  // Copy from the VCD_SOURCE copy window.
+  /** @type {number} */
+  var XD3_TGTCPY = 4;  // Copy from earlier in the target window.
+  /** @type {number} */
+  var XD3_OLDCPY = 5;  // Copy from an earlier target window (VCD_TARGET).
+
   /** @type {number} */
   var MIN_MATCH = 4;
 
@@ -109,23 +673,105 @@
   var VCD_TARGET = 0x02;
   var VCD_ADLER32 = 0x04;
 
+  /**
+   * Delta indicator bits, the secondary compressed sections.
+   */
+  /** @type {number} */
+  var VCD_DATACOMP = 0x01;
+  /** @type {number} */
+  var VCD_INSTCOMP = 0x02;
+  /** @type {number} */
+  var VCD_ADDRCOMP = 0x04;
+  /** @type {number} */
+  var VCD_INVDEL = ~(VCD_DATACOMP | VCD_INSTCOMP | VCD_ADDRCOMP);
+
+  /**
+   * The secondary compressor IDs of the C code, which this decoder does not
+   * implement.
+   */
+  var xd3_sec_unavailable = {
+    2: 'LZMA',  // VCD_LZMA_ID
+    16: 'FGK Adaptive Huffman'  // VCD_FGK_ID
+  };
+
+  /**
+   * The IDs of the DJW and zstd secondary compressors, which this decoder
+   * implements.
+   * @type {number}
+   */
+  var VCD_DJW_ID = 1;
+  /** @type {number} */
+  var VCD_ZSTD_ID = 3;
+
+  /**
+   * The secondary compressors by ID, see registerSecondary.
+   * @type {!Object<number, !XDelta3Decoder.SecondaryType>}
+   */
+  var xd3_sec_types = {};
+
+  var XD3_ADLER32_NOVER = XDelta3Decoder.XD3_ADLER32_NOVER;
+
+  /**
+   * The default fileSource block size.
+   * @type {number}
+   */
+  var XD3_DEFAULT_SRCBLKSZ = 1 << 20;
+
+  /**
+   * The default number of source blocks to cache.
+   * @type {number}
+   */
+  var XD3_DEFAULT_SRCBLOCKS = 16;
+
+  /**
+   * The default VCD_TARGET history size of decodeWindows, the C default
+   * window size.
+   * @type {number}
+   */
+  var XD3_DEFAULT_HISTORY = 1 << 23;
+
+  /**
+   * The arena regions are a multiple of this, like the C XD3_ALLOCSIZE.
+   * @type {number}
+   */
+  var XD3_ALLOCSIZE = 1 << 14;
+
+  /**
+   * The default number of decoders a pool keeps, see createPool.
+   * @type {number}
+   */
+  var XD3_DEFAULT_POOL_STREAMS = 4;
+
+  /**
+   * The delta of a decoder in a pool.
+   * @type {!Uint8Array}
+   */
+  var XD3_EMPTY = new Uint8Array(0);
+
+  /**
+   * The name decodeParallel gives its workers.
+   * @type {string}
+   */
+  var XD3_WORKER_NAME = 'XDelta3Decoder';
+
 
   /**
    * Declares the main decode class.
    * @param {!Uint8Array} delta The Xdelta3 delta file.
-   * @param {Uint8Array=} opt_source The source file (optional).
+   * @param {(Uint8Array|XDelta3Decoder.Source)=} opt_source The source file
+   *     (optional).
+   * @param {number=} opt_flags XDelta3Decoder.XD3_* flags (optional).
    * @constructor
    */
-  function _XDelta3Decoder(delta, opt_source) {
+  function _XDelta3Decoder(delta, opt_source, opt_flags) {
     /** @type {!Uint8Array} */
     this.delta = delta;
 
-    var source = opt_source || new Uint8Array(1);
-    /** @type {!DataObject} */
-    this.source = new DataObject(source);
+    /** @type {number} */
+    this.flags = opt_flags || 0;
 
     /** @type {!xd3_source} */
-    this.src = new xd3_source();
+    this.src = new xd3_source(opt_source || null);
 
     /** @type {number} */
     this.position = 0;
@@ -137,28 +783,43 @@
     this.dec_winstart = 0;
 
     /**
-     * The length of the target window.
+     * Where the current window starts in dec_buffer.
      * @type {number}
      */
-    this.dec_tgtlen = 0;
+    this.dec_tgtaddrbase = 0;
 
     /**
-     * The Alder32 checksum. This is used to verify the decoded bytes checksum
-     * matches the checksum of the original.
+     * Returns the buffer for each window when the caller places them, see
+     * decodeWindows.
+     * @type {?function(number, number, number): !Uint8Array}
      */
-    this.dec_adler32 = 0;
+    this.dec_getwin = null;
+
+    /**
+     * The end of the target for VCD_TARGET copies when the earlier windows
+     * are not kept in the output.
+     * @type {?xd3_history}
+     */
+    this.dec_history = null;
+
+    /**
+     * Where the section, checksum and code table buffers come from, see
+     * createArena. They are allocated one by one without it.
+     * @type {?xd3_arena}
+     */
+    this.dec_arena = null;
 
     /**
-     * First half instruction.
-     * @type {!xd3_hinst}
+     * The length of the target window.
+     * @type {number}
      */
-    this.dec_current1 = new xd3_hinst();
+    this.dec_tgtlen = 0;
 
     /**
-     * Second half instruction.
-     * @type {!xd3_hinst}
+     * The Alder32 checksum. This is used to verify the decoded bytes checksum
+     * matches the checksum of the original.
      */
-    this.dec_current2 = new xd3_hinst();
+    this.dec_adler32 = 0;
 
     /** @type {!xd3_desect} */
     this.data_sect = new xd3_desect();
@@ -169,6 +830,36 @@
     /** @type {!xd3_desect} */
     this.addr_sect = new xd3_desect();
 
+    /**
+     * The secondary compressor from the header, if VCD_SECONDARY.
+     * @type {?XDelta3Decoder.SecondaryType}
+     */
+    this.sec_type = null;
+
+    /**
+     * The secondary compressor state of the data, inst and addr sections.
+     * @type {!Array<*>}
+     */
+    this.sec_streams = [null, null, null];
+
+    /**
+     * The sections decompressed by workers, see decodeParallel.
+     * @type {?xd3_secpipe}
+     */
+    this.dec_secpipe = null;
+
+    /**
+     * The decoded instructions of the current window.
+     * @type {!xd3_winops}
+     */
+    this.dec_ops = new xd3_winops();
+
+    /**
+     * The number of copies of each address mode, see analyze.
+     * @type {?Float64Array}
+     */
+    this.dec_modes = null;
+
     /**
      * The address cache.
      * @type {!xd3_addr_cache}
@@ -178,17 +869,98 @@
         __rfc3284_code_table_desc.same_modes);
   }
 
+  /**
+   * Readies the decoder for another delta, like the C xd3_stream_reset
+   * rather than xd3_free_stream and xd3_config_stream. The address caches,
+   * the instruction list and the arena are kept, and so is the source with
+   * its cached blocks when it is the same source as before.
+   * @param {!Uint8Array} delta The Xdelta3 delta file.
+   * @param {(Uint8Array|XDelta3Decoder.Source)=} opt_source The source file
+   *     (optional).
+   * @param {number=} opt_flags XDelta3Decoder.XD3_* flags (optional).
+   */
+  _XDelta3Decoder.prototype.xd3_stream_reset = function(delta, opt_source,
+      opt_flags) {
+    this.delta = delta;
+    this.flags = opt_flags || 0;
+    if (this.src.source !== (opt_source || null)) {
+      this.src = new xd3_source(opt_source || null);
+    }
+    this.position = 0;
+    this.dec_window_count = 0;
+    this.dec_winstart = 0;
+    this.dec_tgtaddrbase = 0;
+    this.dec_getwin = null;
+    this.dec_history = null;
+    this.dec_buffer = null;
+    this.dec_tgtlen = 0;
+    this.dec_adler32 = 0;
+    xd3_reset_section(this.data_sect);
+    xd3_reset_section(this.inst_sect);
+    xd3_reset_section(this.addr_sect);
+    this.sec_type = null;
+    this.sec_streams = [null, null, null];
+    this.dec_secpipe = null;
+    this.dec_modes = null;
+    if (this.dec_arena) {
+      this.dec_arena.xd3_arena_reset();
+    }
+  };
+
+  /**
+   * @param {!xd3_desect} sect
+   */
+  function xd3_reset_section(sect) {
+    sect.bytes = null;
+    sect.size = 0;
+    sect.pos = 0;
+  }
+
+  /**
+   * Takes the buffers from an arena, see createArena.
+   * @param {?xd3_arena|undefined} arena
+   */
+  _XDelta3Decoder.prototype.xd3_set_arena = function(arena) {
+    if (arena) {
+      arena.xd3_arena_reset();
+      this.dec_arena = arena;
+    }
+  };
+
+  /**
+   * Decodes the delta into output, which has to be at least as long as the
+   * target.
+   * @param {!Uint8Array} output
+   * @return {number} The length of the target.
+   */
+  _XDelta3Decoder.prototype.xd3_decode_into = function(output) {
+    this.xd3_decode_header();
+    var wins = this.xd3_scan_windows();
+    if (wins.tgt_pos[wins.count] > output.length) {
+      throw new Error('target exceeds output buffer');
+    }
+    this.xd3_decode_windows(output);
+    return wins.tgt_pos[wins.count];
+  };
+
   /**
    * Allocates the address caches.
    */
   _XDelta3Decoder.prototype.xd3_alloc_cache = function() {
-    this.acache.near_array = null;  // not sure this is needed
-    this.acache.same_array = null;  // not sure this is needed
-    if (this.acache.s_near > 0) {
-      this.acache.near_array = allocArray(this.acache.s_near, 0);
+    /* A reset stream keeps caches of the same size, which
+     * xd3_init_cache clears for each window. */
+    var acache = this.acache;
+    if (acache.s_near == 0) {
+      acache.near_array = null;
+    } else if (!acache.near_array ||
+        acache.near_array.length != acache.s_near) {
+      acache.near_array = allocArray(acache.s_near, 0);
     }
-    if (this.acache.s_same > 0) {
-      this.acache.same_array = allocArray(this.acache.s_same * 256, 0);
+    if (acache.s_same == 0) {
+      acache.same_array = null;
+    } else if (!acache.same_array ||
+        acache.same_array.length != acache.s_same * 256) {
+      acache.same_array = allocArray(acache.s_same * 256, 0);
     }
   };
 
@@ -197,6 +969,55 @@
    * @return {!Uint8Array}
    */
   _XDelta3Decoder.prototype.xd3_decode_input = function() {
+    this.xd3_decode_header();
+    var wins = this.xd3_scan_windows();
+    return this.xd3_decode_windows(new Uint8Array(wins.tgt_pos[wins.count]));
+  };
+
+  /**
+   * Decodes the windows that overlap a range of the target.
+   * @param {!xd3_winlist} wins The windows of this delta.
+   * @param {number} offset
+   * @param {number} length
+   * @return {!Uint8Array} The range.
+   */
+  _XDelta3Decoder.prototype.xd3_decode_range = function(wins, offset, length) {
+    if (offset < 0 || length < 0 || offset + length > wins.tgt_pos[wins.count]) {
+      throw new Error('range exceeds target');
+    }
+    if (length == 0) {
+      return new Uint8Array(0);
+    }
+
+    // Find the first and last windows of the range.
+    var first = xd3_find_window(wins, offset);
+    var last = xd3_find_window(wins, offset + length - 1);
+
+    /* A VCD_TARGET window copies from earlier in the target, which has to be
+     * decoded too. Start from the beginning rather than trace it. */
+    for (var i = 0; i <= last; i++) {
+      if (wins.win_ind[i] & VCD_TARGET) {
+        first = 0;
+        break;
+      }
+    }
+    /* So does a secondary compressor that carries state between windows. */
+    if (this.sec_type && !this.sec_type.independent) {
+      first = 0;
+    }
+
+    var output = new Uint8Array(wins.tgt_pos[last + 1] - wins.tgt_pos[first]);
+    this.position = wins.delta_pos[first];
+    this.xd3_decode_windows(output, wins.delta_pos[last + 1]);
+
+    var start = offset - wins.tgt_pos[first];
+    return output.subarray(start, start + length);
+  };
+
+  /**
+   * Parses the delta file header, leaving this.position at the first window.
+   */
+  _XDelta3Decoder.prototype.xd3_decode_header = function() {
 
     if (this.delta[0] != 0xD6 ||  // 'V' with MSB set
         this.delta[1] != 0xC3 ||  // 'C' with MSB set
@@ -212,11 +1033,34 @@
     }
 
     if (this.dec_hdr_ind & VCD_SECONDARY) {
-      throw new Error('VCD_SECONDARY not implemented');
+      this.dec_secondid = this.getByte();  // DEC_SECONDID
+      this.sec_type = xd3_sec_types[this.dec_secondid] || null;
+      if (!this.sec_type) {
+        if (xd3_sec_unavailable[this.dec_secondid]) {
+          throw new Error('unavailable secondary compressor: ' +
+              xd3_sec_unavailable[this.dec_secondid]);
+        }
+        throw new Error('unknown secondary compressor ID');
+      }
     }
 
     if (this.dec_hdr_ind & VCD_CODETABLE) {
-      throw new Error('VCD_CODETABLE support was removed');
+      this.dec_codetblsz = this.getInteger();  // DEC_TABLEN
+      /* The length counts the near and same bytes. */
+      if (this.dec_codetblsz <= 2) {
+        throw new Error('invalid code table size');
+      }
+      this.acache.s_near = this.getByte();  // DEC_NEAR
+      this.acache.s_same = this.getByte();  // DEC_SAME
+      this.dec_codetblsz -= 2;
+      if (this.position + this.dec_codetblsz > this.delta.length) {
+        throw new Error(
+            'XD3_INVALID_INPUT code table extends past end of input');
+      }
+      this.dec_codetbl =
+          this.xd3_decode_allocate(this.dec_codetblsz);  // DEC_TABDAT
+      this.code_table = xd3_apply_table_encoding(this.dec_codetbl,
+          2 + this.acache.s_near + this.acache.s_same);
     } else {
       /* Use the default table. */
       this.acache.s_near = __rfc3284_code_table_desc.near_modes;
@@ -233,28 +1077,210 @@
       this.xd3_decode_bytes(this.dec_apphead, 0, this.dec_appheadsz);
       this.dec_apphead[this.dec_appheadsz + 1] = 0;
     }
+    if (this.dec_arena) {
+      this.dec_arena.xd3_arena_keep();
+    }
+  };
 
-    //var targetLength = 0;
-    while (true) {
-      if (this.position >= this.delta.length) {
-        break;
+  /**
+   * Finds the windows from this.position to the end of the delta by reading
+   * only the window headers, which is much cheaper than decoding them.
+   * @return {!xd3_winlist}
+   */
+  _XDelta3Decoder.prototype.xd3_scan_windows = function() {
+    var wins = new xd3_winlist();
+    var start = this.position;
+    var tgtpos = 0;
+
+    while (this.position < this.delta.length) {
+      var win_ind = this.getByte();
+      wins.delta_pos.push(this.position - 1);
+      wins.tgt_pos.push(tgtpos);
+      wins.win_ind.push(win_ind);
+      wins.count++;
+      var cpylen = 0;
+      var cpyoff = 0;
+      if (win_ind & (VCD_SOURCE | VCD_TARGET)) {
+        cpylen = this.getInteger();  // DEC_CPYLEN
+        cpyoff = this.getInteger();  // DEC_CPYOFF
       }
-      //targetLength +=
-      this.handleWindow();
+      wins.cpylen.push(cpylen);
+      wins.cpyoff.push(cpyoff);
+      var enclen = this.getInteger();
+      var next = this.position + enclen;
+      tgtpos += this.getInteger();  // DEC_TGTLEN
+      if (next > this.delta.length) {
+        throw new Error('XD3_INVALID_INPUT window extends past end of input');
+      }
+      this.position = next;
     }
-    return this.dec_buffer.bytes;
-  };
+    wins.delta_pos.push(this.position);
+    wins.tgt_pos.push(tgtpos);
 
-  _XDelta3Decoder.prototype.xd3_decode_init_window = function() {
-    this.dec_cpylen = 0;
-    this.dec_cpyoff = 0;
-    // this.dec_cksumbytes = 0;
+    this.position = start;
+    return wins;
+  };
 
-    xd3_init_cache(this.acache);
-  }
+  /**
+   * Copies out the secondary compressed sections of each window, for the
+   * workers of xd3_decode_section_workers.
+   * @param {!xd3_winlist} wins
+   * @return {!Array<!Array<?Uint8Array>>} The DATA, INST and ADDR sections
+   *     by window, null where a section is not compressed.
+   */
+  _XDelta3Decoder.prototype.xd3_find_sections = function(wins) {
+    var start = this.position;
+    var sections = [[], [], []];
+    for (var i = 0; i < wins.count; i++) {
+      this.position = wins.delta_pos[i] + 1;
+      if (wins.win_ind[i] & (VCD_SOURCE | VCD_TARGET)) {
+        this.getInteger();  // DEC_CPYLEN
+        this.getInteger();  // DEC_CPYOFF
+      }
+      this.getInteger();  // DEC_ENCLEN
+      this.getInteger();  // DEC_TGTLEN
+      var del_ind = this.getByte();
+      var sizes = [this.getInteger(), this.getInteger(), this.getInteger()];
+      if (wins.win_ind[i] & VCD_ADLER32) {
+        this.position += 4;
+      }
+      for (var which = 0; which < 3; which++) {
+        sections[which].push((del_ind & (1 << which)) ?
+            this.delta.slice(this.position, this.position + sizes[which]) :
+            null);
+        this.position += sizes[which];
+      }
+    }
+    this.position = start;
+    return sections;
+  };
+
+  /**
+   * Sets where the windows go.
+   * @param {?Uint8Array} output The whole target, starting at 0, or null to
+   *     ask this.dec_getwin for each window.
+   */
+  _XDelta3Decoder.prototype.xd3_set_output = function(output) {
+    this.dec_buffer = output ? new DataObject(output) : null;
+    this.dec_winstart = 0;
+    this.dec_tgtlen = 0;
+  };
+
+  /**
+   * Decodes the windows from this.position to the end of the delta.
+   * @param {?Uint8Array} output Where the windows go, starting at 0, see
+   *     xd3_set_output.
+   * @param {number=} opt_end Where in the delta to stop (optional).
+   * @return {?Uint8Array} The output.
+   */
+  _XDelta3Decoder.prototype.xd3_decode_windows = function(output, opt_end) {
+    var end = (opt_end === undefined) ? this.delta.length : opt_end;
+    this.xd3_set_output(output);
+
+    while (true) {
+      if (this.position >= end) {
+        break;
+      }
+      this.handleWindow();
+      this.xd3_decode_emit();
+    }
+    return output;
+  };
+
+  /**
+   * Decodes the instructions of the windows from this.position to the end
+   * of the delta without producing the target. fn is called for each
+   * window once its instructions are in this.dec_ops.
+   * @param {function()} fn
+   */
+  _XDelta3Decoder.prototype.xd3_walk_windows = function(fn) {
+    this.xd3_set_output(null);
+    while (this.position < this.delta.length) {
+      this.handleWindow();
+      this.xd3_decode_instructions();
+      fn();
+      this.xd3_decode_finish_window();
+    }
+  };
+
+  /**
+   * Like xd3_decode_windows, but reads the source blocks of each window with
+   * the Source's getblkAsync before producing the window.
+   * @param {!Uint8Array} output Where the windows go, starting at 0.
+   * @return {!Promise<!Uint8Array>} The output.
+   */
+  _XDelta3Decoder.prototype.xd3_decode_windows_async = function(output) {
+    var self = this;
+    this.xd3_set_output(output);
+
+    var next = function() {
+      while (self.position < self.delta.length) {
+        self.handleWindow();
+        self.xd3_decode_instructions();
+        var fetch = self.xd3_prefetch_window();
+        if (fetch) {
+          return fetch.then(function() {
+            self.xd3_decode_output();
+            return next();
+          });
+        }
+        self.xd3_decode_output();
+      }
+      return output;
+    };
+    return Promise.resolve().then(next);
+  };
+
+  /**
+   * Starts reading the source blocks that the window's decoded instructions
+   * copy from and that are not cached, all at once.
+   * @return {?Promise} Resolves when they are cached, null if none are
+   *     needed.
+   */
+  _XDelta3Decoder.prototype.xd3_prefetch_window = function() {
+    var src = this.src;
+    if (!src.getblkAsync) {
+      return null;
+    }
+    var ops = this.dec_ops;
+    var wanted = new Set();
+    for (var i = 0; i < ops.count; i++) {
+      if (ops.type[i] != XD3_SRCCPY) {
+        continue;
+      }
+      var first = Math.floor(ops.addr[i] / src.blksize);
+      var last = Math.floor((ops.addr[i] + ops.size[i] - 1) / src.blksize);
+      for (var blkno = first; blkno <= last; blkno++) {
+        if (blkno != src.curblkno && !src.blkcache.has(blkno)) {
+          wanted.add(blkno);
+        }
+      }
+    }
+    if (wanted.size == 0) {
+      return null;
+    }
+    var reads = [];
+    wanted.forEach(function(blkno) {
+      reads.push(src.getblkAsync(blkno).then(function(blk) {
+        src.xd3_putblk(blkno, blk);
+      }));
+    });
+    return Promise.all(reads);
+  };
+
+  _XDelta3Decoder.prototype.xd3_decode_init_window = function() {
+    this.dec_cpylen = 0;
+    this.dec_cpyoff = 0;
+    // this.dec_cksumbytes = 0;
+
+    xd3_init_cache(this.acache);
+  }
 
   _XDelta3Decoder.prototype.handleWindow = function() {
     this.dec_win_ind = this.delta[this.position++];  // DEC_WININD
+    if (this.dec_arena) {
+      this.dec_arena.xd3_arena_window();
+    }
 
     if (this.dec_win_ind & ~7) {
       throw new Error('VCD_INVWIN unexpected bits set');
@@ -279,7 +1305,19 @@
       this.dec_cpyoff = sourcePosition;
     }
 
+    /* Check copy window bounds: VCD_TARGET window may not exceed
+       current position. */
+    if ((this.dec_win_ind & VCD_TARGET) &&
+        (this.dec_cpyoff + this.dec_cpylen > this.dec_winstart)) {
+      throw new Error('VCD_TARGET window out of bounds');
+    }
+    if ((this.dec_win_ind & VCD_TARGET) && this.dec_history &&
+        this.dec_cpyoff < this.dec_winstart - this.dec_history.bytes.length) {
+      throw new Error('VCD_TARGET window is older than the history');
+    }
+
     this.dec_enclen = this.getInteger();  // DEC_ENCLEN
+    var encpos = this.position;
 
     // Calculate the position if the delta was actually read.
     // var positionAfterDelta = this.position + this.dec_enclen;
@@ -287,12 +1325,28 @@
     // Get the target window length.
     this.dec_tgtlen = this.getInteger();  // DEC_TGTLEN
 
+    // The maximum value for dec_position.
+    this.dec_maxpos = this.dec_cpylen + this.dec_tgtlen;
+
     this.dec_del_ind = this.getByte();  // DEC_DELIND
+    if (this.dec_del_ind & VCD_INVDEL) {
+      throw new Error('unrecognized delta indicator bits set');
+    }
+    /* Delta indicator is only used with secondary compression. */
+    if (this.dec_del_ind != 0 && !this.sec_type) {
+      throw new Error('invalid delta indicator bits set');
+    }
 
     this.data_sect.size = this.getInteger();  // DEC_DATALEN
     this.inst_sect.size = this.getInteger();  // DEC_INSTLEN
     this.addr_sect.size = this.getInteger();  // DEC_ADDRLEN
 
+    if (this.dec_arena) {
+      this.dec_arena.xd3_arena_reserve(Math.min(this.data_sect.size +
+          this.inst_sect.size + this.addr_sect.size + 4,
+          this.delta.length - this.position));
+    }
+
     if (this.dec_win_ind & VCD_ADLER32) {  // DEC_CKSUM
       this.dec_cksum = this.xd3_decode_allocate(4);
       for (var i = 0; i < 4; i += 1) {
@@ -302,6 +1356,12 @@
 
     this.xd3_decode_sections();
 
+    /* Check dec_enclen, which xd3_scan_windows relies on to find the next
+     * window. */
+    if (this.position - encpos != this.dec_enclen) {
+      throw new Error('incorrect encoding length (redundent)');
+    }
+
     /* In the C++ code:
      *     To speed VCD_SOURCE block-address calculations, the source
      *     cpyoff_blocks and cpyoff_blkoff are pre-computed.
@@ -310,22 +1370,77 @@
     if (this.dec_win_ind & VCD_SOURCE) {
       this.src.cpyoff_blkoff = this.dec_cpyoff;
     }
-    this.xd3_decode_emit();
 
     return this.dec_tgtlen;
   };
 
   /**
-   * This function only has code if the preprocessor statement
-   * "#if SECONDARY_ANY" is set. SECONDARY_ANY does not seem to be set.
+   * Decompresses the sections the delta indicator marks.
    */
-  _XDelta3Decoder.prototype.xd3_decode_secondary_sections = function() {  //
+  _XDelta3Decoder.prototype.xd3_decode_secondary_sections = function() {
+    if (this.dec_del_ind & VCD_DATACOMP) {
+      this.xd3_decode_secondary(this.data_sect, 0);
+    }
+    if (this.dec_del_ind & VCD_INSTCOMP) {
+      this.xd3_decode_secondary(this.inst_sect, 1);
+    }
+    if (this.dec_del_ind & VCD_ADDRCOMP) {
+      this.xd3_decode_secondary(this.addr_sect, 2);
+    }
+  };
+
+  /**
+   * Replaces a section with its decompressed bytes, which xd3_secpipe
+   * workers may have decompressed already.
+   * @param {!xd3_desect} sect
+   * @param {number} which The section's index in this.sec_streams.
+   */
+  _XDelta3Decoder.prototype.xd3_decode_secondary = function(sect, which) {
+    var output;
+    if (this.dec_secpipe) {
+      output = this.dec_secpipe.take(which, this.current_window);
+    } else {
+      if (!this.sec_streams[which]) {
+        this.sec_streams[which] = this.sec_type.alloc();
+      }
+      output = xd3_decode_secondary_bytes(this.sec_type,
+          this.sec_streams[which], sect.bytes, this.dec_arena);
+    }
+    sect.bytes = output;
+    sect.size = output.length;
   };
 
+  /**
+   * Decompresses a section. A compressed section is the decompressed size
+   * followed by the compressor's data.
+   * @param {!XDelta3Decoder.SecondaryType} type
+   * @param {*} state The section type's state, from type.alloc().
+   * @param {!Uint8Array} bytes The compressed section.
+   * @param {?xd3_arena=} opt_arena Where the output goes (optional).
+   * @return {!Uint8Array}
+   */
+  function xd3_decode_secondary_bytes(type, state, bytes, opt_arena) {
+    var input = new DataObject(bytes);
+    var dec_size;
+    try {
+      dec_size = input.getInteger();
+    } catch (e) {
+      throw new Error('secondary decoder invalid output size');
+    }
+    var output = opt_arena ? opt_arena.xd3_arena_alloc(dec_size) :
+        new Uint8Array(dec_size);
+    var used = type.decode(state, bytes.subarray(input.pos), output);
+    if (used != dec_size) {
+      throw new Error('secondary decoder short output');
+    }
+    return output;
+  }
+
   /**
    * @param {!xd3_desect} sect
    */
   _XDelta3Decoder.prototype.xd3_decode_section = function(sect) {
+    sect.stored = sect.size;
     // It is possible to just point into the buffer but perhaps that can be done
     // later.
     sect.bytes = this.xd3_decode_allocate(sect.size);
@@ -342,7 +1457,26 @@
   };
 
   _XDelta3Decoder.prototype.xd3_decode_setup_buffers = function() {
-    this.dec_buffer = new DataObject(new Uint8Array(this.dec_tgtlen));
+    if (this.dec_getwin) {
+      /* The caller places each window, so its target copies are relative to
+       * the start of the returned buffer. */
+      var bytes = this.dec_getwin(this.current_window, this.dec_winstart,
+          this.dec_tgtlen);
+      if (!bytes || bytes.length < this.dec_tgtlen) {
+        throw new Error('target window exceeds output buffer');
+      }
+      this.dec_buffer = new DataObject(bytes);
+      this.dec_tgtaddrbase = 0;
+    } else if (this.dec_buffer) {
+      if (this.dec_winstart + this.dec_tgtlen > this.dec_buffer.bytes.length) {
+        throw new Error('target window exceeds output buffer');
+      }
+      this.dec_tgtaddrbase = this.dec_winstart;
+    } else {
+      /* xd3_walk_windows does not produce the target. */
+      return;
+    }
+    this.dec_buffer.pos = this.dec_tgtaddrbase;
   };
 
   var VCD_SELF = 0;
@@ -381,6 +1515,22 @@
     return val;
   };
 
+  /**
+   * xd3_decode_address that counts the address modes in this.dec_modes.
+   * analyze puts it on its own decoder, so decoding does not pay for the
+   * counting.
+   * @param {number} here
+   * @param {number} mode
+   * @param {!xd3_desect} sect
+   * @return {number}
+   * @this {_XDelta3Decoder}
+   */
+  function xd3_decode_address_counted(here, mode, sect) {
+    this.dec_modes[mode]++;
+    return _XDelta3Decoder.prototype.xd3_decode_address.call(this, here, mode,
+        sect);
+  }
+
   /**
    * @param {!xd3_addr_cache} acache
    * @param {number} addr
@@ -397,90 +1547,399 @@
   };
 
   /**
-   * @param {!xd3_hinst} inst
+   * The fused Adler32 checksum trails the output by at most this many bytes,
+   * so it reads them while they are still in cache.
+   * @type {number}
    */
-  _XDelta3Decoder.prototype.xd3_decode_output_halfinst = function(inst) {
-    var take = inst.size;
-    var blkoff;
+  var XD3_ADLER32_CHUNK = 1 << 14;
 
-    switch (inst.type) {
-      case XD3_RUN:
-        var val = this.data_sect.getByte();
-        this.dec_buffer.fill(val, take);
-        break;
+  /**
+   * Produces the target window from the instructions decoded by
+   * xd3_decode_instructions. All of the bounds checks were done while
+   * decoding so this loop only moves bytes.
+   * @param {boolean} cksum Whether to compute the Adler32 checksum of the
+   *     window as it is produced.
+   * @return {number} The checksum, if computed.
+   */
+  _XDelta3Decoder.prototype.xd3_decode_execute = function(cksum) {
+    var ops = this.dec_ops;
+    var type = ops.type;
+    var size = ops.size;
+    var addr = ops.addr;
+    var count = ops.count;
+    var out = this.dec_buffer.bytes;
+    var pos = this.dec_buffer.pos;
+    var tgtaddrbase = this.dec_tgtaddrbase;
+    var history = this.dec_history;
+    var data = this.data_sect.bytes;
+    var src = this.src;
+    var a32 = 1;
+    var a32_pos = pos;
+
+    for (var i = 0; i < count; i++) {
+      var from = addr[i];
+      var end = pos + size[i];
+
+      switch (type[i]) {
+        case XD3_RUN:
+          xd3_fill(out, pos, data[from], size[i]);
+          break;
 
-      case XD3_ADD:
-        this.dec_buffer.copySect(this.data_sect, take);
-        break;
+        case XD3_ADD:
+          xd3_copy_bytes(out, pos, data, from, size[i]);
+          break;
 
-      default:
-        var overlap;
-        var overlap_pos;
-        if (inst.addr < this.dec_cpylen) {
-          overlap = 0;
-          if (this.dec_win_ind & VCD_TARGET) {
-            throw new Error('VCD_TARGET not supported');
+        case XD3_SRCCPY:
+          xd3_copy_source(src, out, pos, from, size[i]);
+          break;
+
+        case XD3_OLDCPY:
+          if (history) {
+            history.xd3_history_copy(out, pos, from, size[i]);
           } else {
-            blkoff = this.src.cpyoff_blkoff;
-            blkoff = this.dec_cpyoff + inst.addr;
+            // The whole target so far is in the output.
+            xd3_copy_bytes(out, pos, out, from, size[i]);
           }
-        } else {
-          overlap = 1;
-          overlap_pos = inst.addr - this.dec_cpylen;
-        }
-        if (overlap) {
-          this.dec_buffer.copyBytes(this.dec_buffer.bytes, overlap_pos, take);
-        } else {
-          this.dec_buffer.copyBytes(this.source.bytes, blkoff, take);
+          break;
+
+        default:
+          xd3_copy_target(out, pos, tgtaddrbase + from, size[i]);
+      }
+      pos = end;
+
+      if (cksum && pos - a32_pos >= XD3_ADLER32_CHUNK) {
+        a32 = adler32(a32, out, a32_pos, pos - a32_pos);
+        a32_pos = pos;
+      }
+    }
+    this.dec_buffer.pos = pos;
+
+    if (cksum) {
+      a32 = adler32(a32, out, a32_pos, pos - a32_pos);
+    }
+    return a32;
+  };
+
+  /**
+   * Copies and fills shorter than this are done a byte at a time. Above it
+   * the typed array routines win despite their call overhead.
+   * @type {number}
+   */
+  var XD3_MEMCPY_MIN = 32;
+
+  /**
+   * @param {!Uint8Array} bytes
+   * @param {number} pos
+   * @param {number} val
+   * @param {number} len
+   */
+  function xd3_fill(bytes, pos, val, len) {
+    if (len < XD3_MEMCPY_MIN) {
+      for (var end = pos + len; pos < end; pos++) {
+        bytes[pos] = val;
+      }
+    } else {
+      bytes.fill(val, pos, pos + len);
+    }
+  }
+
+  /**
+   * Copies between two buffers that do not overlap.
+   * @param {!Uint8Array} dst_bytes
+   * @param {number} dst
+   * @param {!Uint8Array} src_bytes
+   * @param {number} src
+   * @param {number} len
+   */
+  function xd3_copy_bytes(dst_bytes, dst, src_bytes, src, len) {
+    if (len < XD3_MEMCPY_MIN) {
+      for (var end = dst + len; dst < end; dst++) {
+        dst_bytes[dst] = src_bytes[src++];
+      }
+    } else {
+      dst_bytes.set(src_bytes.subarray(src, src + len), dst);
+    }
+  }
+
+  /**
+   * Copies from the source, a block at a time.
+   * @param {!xd3_source} src
+   * @param {!Uint8Array} out
+   * @param {number} pos
+   * @param {number} from The source offset.
+   * @param {number} len
+   */
+  function xd3_copy_source(src, out, pos, from, len) {
+    /* Most copies are within the current block, which needs no lookup. */
+    var blkoff = from - src.curblkno * src.blksize;
+    if (src.curblkno >= 0 && blkoff >= 0 && blkoff + len <= src.blksize) {
+      src.stats.hits++;
+      xd3_copy_bytes(out, pos, src.curblk, blkoff, len);
+      return;
+    }
+    while (len > 0) {
+      var blkno = Math.floor(from / src.blksize);
+      var blkoff = from - blkno * src.blksize;
+      var blk = src.xd3_getblk(blkno);
+      var take = Math.min(len, src.blksize - blkoff);
+      xd3_copy_bytes(out, pos, blk, blkoff, take);
+      pos += take;
+      from += take;
+      len -= take;
+    }
+  }
+
+  /**
+   * Copies from earlier in the same buffer (src < dst) with the result of a
+   * forward byte-at-a-time copy: when the ranges overlap the dst - src bytes
+   * before dst repeat.
+   * @param {!Uint8Array} bytes
+   * @param {number} dst
+   * @param {number} src
+   * @param {number} len
+   */
+  function xd3_copy_target(bytes, dst, src, len) {
+    var dist = dst - src;
+    var done, take;
+
+    if (len < XD3_MEMCPY_MIN) {
+      for (var end = dst + len; dst < end; dst++) {
+        bytes[dst] = bytes[src++];
+      }
+    } else if (dist == 1) {
+      bytes.fill(bytes[src], dst, dst + len);
+    } else {
+      /* Replicate the pattern in chunks that are whole periods of dist and
+       * no longer than what is already written, so copyWithin never sees
+       * overlapping ranges. A copy that does not overlap takes one chunk.
+       * Short periods are first seeded with the byte loop to skip the
+       * smallest chunks. */
+      done = 0;
+      if (dist < XD3_MEMCPY_MIN) {
+        done = Math.min(len, dist * Math.ceil(XD3_MEMCPY_MIN / dist));
+        for (var i = 0; i < done; i++) {
+          bytes[dst + i] = bytes[src + i];
         }
+      }
+      for (; done < len; done += take) {
+        take = Math.min(dist + done, len - done);
+        bytes.copyWithin(dst + done, src, src + take);
+      }
+    }
+  }
+
+  /**
+   * Decodes a RUN and appends it to the window's instruction list.
+   * @param {number} size
+   */
+  _XDelta3Decoder.prototype.xd3_decode_run = function(size) {
+    /* Check: The instruction will not overflow the output buffer. */
+    if (this.dec_position + size > this.dec_maxpos) {
+      throw new Error('size too large');
+    }
+    this.dec_position += size;
+
+    /* RUN needs a single data byte. */
+    var ops = this.dec_ops;
+    var n = ops.count++;
+    ops.type[n] = XD3_RUN;
+    ops.size[n] = size;
+    ops.addr[n] = this.dec_datapos;
+    if (++this.dec_datapos > this.data_sect.size) {
+      throw new Error('data underflow');
     }
   };
 
   /**
-   * xref: xd3_decode_parse_halfinst
-   * @param {!xd3_hinst} inst
+   * Decodes an ADD and appends it to the window's instruction list.
+   * @param {number} size
+   */
+  _XDelta3Decoder.prototype.xd3_decode_add = function(size) {
+    if (this.dec_position + size > this.dec_maxpos) {
+      throw new Error('size too large');
+    }
+    this.dec_position += size;
+
+    /* ADD needs SIZE data bytes. */
+    var ops = this.dec_ops;
+    var n = ops.count++;
+    ops.type[n] = XD3_ADD;
+    ops.size[n] = size;
+    ops.addr[n] = this.dec_datapos;
+    this.dec_datapos += size;
+    if (this.dec_datapos > this.data_sect.size) {
+      throw new Error('data underflow');
+    }
+  };
+
+  /**
+   * Decodes a COPY's address and appends it to the window's instruction
+   * list, resolved to where its bytes come from.
+   * @param {number} size
+   * @param {number} mode The address mode.
    */
-  _XDelta3Decoder.prototype.xd3_decode_parse_halfinst = function(inst) {
-    // Get size and address if necessary.
-    if (inst.size == 0) {
-      inst.size = this.inst_sect.getInteger();
+  _XDelta3Decoder.prototype.xd3_decode_copy = function(size, mode) {
+    var addr = this.xd3_decode_address(this.dec_position, mode, this.addr_sect);
+
+    /* Cannot copy an address before it is filled-in. */
+    if (addr >= this.dec_position) {
+      throw new Error('address too large');
     }
 
-    /* For copy instructions, read address. */
-    if (inst.type >= XD3_CPY) {
-      var mode = inst.type - XD3_CPY;
-      inst.addr =
-          this.xd3_decode_address(this.dec_position, mode, this.addr_sect);
+    /* Check: a VCD_TARGET or VCD_SOURCE copy cannot exceed the remaining
+     * buffer space in its own segment. */
+    if (addr < this.dec_cpylen && addr + size > this.dec_cpylen) {
+      throw new Error('size too large');
+    }
+    if (this.dec_position + size > this.dec_maxpos) {
+      throw new Error('size too large');
+    }
+    this.dec_position += size;
+
+    var ops = this.dec_ops;
+    var n = ops.count++;
+    var type;
+    var from;
+    if (addr < this.dec_cpylen && (this.dec_win_ind & VCD_TARGET)) {
+      type = XD3_OLDCPY;
+      from = this.dec_cpyoff + addr;
+    } else if (addr < this.dec_cpylen) {
+      type = XD3_SRCCPY;
+      from = this.dec_cpyoff + addr;
+      if (from + size > this.src.size) {
+        throw new Error('source file too short');
+      }
+    } else {
+      /* The target window addresses start beyond the copy window. */
+      type = XD3_TGTCPY;
+      from = addr - this.dec_cpylen;
     }
+    ops.type[n] = type;
+    ops.size[n] = size;
+    ops.addr[n] = from;
+  };
 
-    this.dec_position += inst.size;
+  /**
+   * xref: xd3_decode_parse_halfinst
+   * @param {number} type The code table type, XD3_CPY + mode for a COPY.
+   * @param {number} size The code table size, 0 if it follows in the
+   *     instruction section.
+   */
+  _XDelta3Decoder.prototype.xd3_decode_halfinst = function(type, size) {
+    // Get size if necessary.
+    if (size == 0) {
+      size = this.inst_sect.getInteger();
+    }
+    switch (type) {
+      case XD3_RUN:
+        this.xd3_decode_run(size);
+        break;
+      case XD3_ADD:
+        this.xd3_decode_add(size);
+        break;
+      default:
+        this.xd3_decode_copy(size, type - XD3_CPY);
+    }
   };
 
   /**
+   * Decodes an instruction with any code table.
    * xref: xd3_decode_instruction
    */
   _XDelta3Decoder.prototype.xd3_decode_instruction = function() {
     var code_table = this.code_table;
     var instPair = this.inst_sect.getByte();
 
-    this.dec_current1.type = code_table.tableRows[instPair].type1;
-    this.dec_current1.size = code_table.tableRows[instPair].size1;
-    // dec_current1.addr keeps it previous value.
-
-    this.dec_current2.type = code_table.tableRows[instPair].type2;
-    this.dec_current2.size = code_table.tableRows[instPair].size2;
-    // dec_current2.addr keeps it previous value.
-
-
     /* For each instruction with a real operation, decode the
      * corresponding size and addresses if necessary.  Assume a
      * code-table may have NOOP in either position, although this is
      * unlikely. */
-    if (this.dec_current1.type != XD3_NOOP) {
-      this.xd3_decode_parse_halfinst(this.dec_current1);
+    var type1 = code_table.type1[instPair];
+    if (type1 != XD3_NOOP) {
+      this.xd3_decode_halfinst(type1, code_table.size1[instPair]);
+    }
+    var type2 = code_table.type2[instPair];
+    if (type2 != XD3_NOOP) {
+      this.xd3_decode_halfinst(type2, code_table.size2[instPair]);
+    }
+  };
+
+  /**
+   * Decodes the instructions of a window that uses the default code table.
+   * Its rows fall into a few classes whose sizes and modes follow from the
+   * opcode (see xd3_build_code_table), so each class is handled with them
+   * as constants and without the NOOP checks:
+   *     0        RUN, size follows
+   *     1        ADD, size follows
+   *     2-18     ADD size 1-17
+   *     19-162   COPY mode 0-8, 16 per mode: size follows, then size 4-18
+   *     163-234  ADD size 1-4, COPY mode 0-5 size 4-6, 12 per mode
+   *     235-246  ADD size 1-4, COPY mode 6-8 size 4, 4 per mode
+   *     247-255  COPY mode 0-8 size 4, ADD size 1
+   */
+  _XDelta3Decoder.prototype.xd3_decode_rfc3284_instructions = function() {
+    var inst_sect = this.inst_sect;
+    var bytes = inst_sect.bytes;
+    var end = inst_sect.size;
+    var mode;
+
+    while (inst_sect.pos < end) {
+      var op = bytes[inst_sect.pos++];
+      if (op >= 163) {
+        if (op < 235) {
+          op -= 163;
+          mode = (op / 12) | 0;
+          op -= mode * 12;
+          this.xd3_decode_add(((op / 3) | 0) + 1);
+          this.xd3_decode_copy(op % 3 + 4, mode);
+        } else if (op < 247) {
+          op -= 235;
+          this.xd3_decode_add((op & 3) + 1);
+          this.xd3_decode_copy(4, 6 + (op >> 2));
+        } else {
+          this.xd3_decode_copy(4, op - 247);
+          this.xd3_decode_add(1);
+        }
+      } else if (op >= 19) {
+        op -= 19;
+        this.xd3_decode_copy((op & 15) ? (op & 15) + 3 :
+            inst_sect.getInteger(), op >> 4);
+      } else if (op >= 2) {
+        this.xd3_decode_add(op - 1);
+      } else if (op == 1) {
+        this.xd3_decode_add(inst_sect.getInteger());
+      } else {
+        this.xd3_decode_run(inst_sect.getInteger());
+      }
+    }
+  };
+
+  /**
+   * Decodes all of the window's instructions into this.dec_ops before any
+   * output is produced. This keeps the varint parsing and address cache
+   * updates out of the loop that moves bytes in xd3_decode_execute.
+   */
+  _XDelta3Decoder.prototype.xd3_decode_instructions = function() {
+    // Each opcode holds at most two half-instructions.
+    this.dec_ops.reset(2 * this.inst_sect.size);
+    this.dec_datapos = 0;
+
+    if (this.code_table === __rfc3284_code_table) {
+      this.xd3_decode_rfc3284_instructions();
+    } else {
+      while (this.inst_sect.pos < this.inst_sect.size) {
+        this.xd3_decode_instruction();
+      }
+    }
+
+    if (this.dec_position != this.dec_maxpos) {
+      throw new Error('wrong window length');
+    }
+    if (this.dec_datapos != this.data_sect.size) {
+      throw new Error('extra data section');
     }
-    if (this.dec_current2.type != XD3_NOOP) {
-      this.xd3_decode_parse_halfinst(this.dec_current2);
+    if (this.addr_sect.pos != this.addr_sect.size) {
+      throw new Error('extra address section');
     }
   };
 
@@ -490,36 +1949,45 @@
     this.data_sect.pos = 0;
     this.inst_sect.pos = 0;
     this.addr_sect.pos = 0;
+    this.dec_window_count += 1;
   };
 
   _XDelta3Decoder.prototype.xd3_decode_emit = function() {
 
-    var instLength = this.inst_sect.bytes.byteLength;
-    /* Decode next instruction pair. */
-    while (this.inst_sect.pos < instLength) {
-      this.xd3_decode_instruction();
+    /* The window is decoded in two passes: first all of the instructions
+     * are decoded and checked, then the output is produced.  The checksum
+     * is computed along with the output. */
+    this.xd3_decode_instructions();
+    this.xd3_decode_output();
+  };
 
-      /* Output dec_current1 */
-      if (this.dec_current1.type != XD3_NOOP) {
-        this.xd3_decode_output_halfinst(this.dec_current1);
-      }
-      /* Output dec_current2 */
-      if (this.dec_current2.type != XD3_NOOP) {
-        this.xd3_decode_output_halfinst(this.dec_current2);
-      }
-    }
-    if (this.dec_win_ind & VCD_ADLER32) {
-      var a32 = adler32(1, this.dec_buffer.bytes, 0, this.dec_tgtlen);
+  /**
+   * The second pass of xd3_decode_emit, after xd3_decode_instructions.
+   */
+  _XDelta3Decoder.prototype.xd3_decode_output = function() {
+    var cksum = (this.dec_win_ind & VCD_ADLER32) != 0 &&
+        (this.flags & XD3_ADLER32_NOVER) == 0;
+    var a32 = this.xd3_decode_execute(cksum);
+    if (cksum) {
       if (a32 != this.dec_adler32) {
         throw new Error('target window checksum mismatch');
       }
     }
 
+    if (this.dec_history) {
+      this.dec_history.xd3_history_append(
+          this.dec_buffer.bytes, this.dec_tgtaddrbase, this.dec_tgtlen);
+    }
+
     /* Finished with a window. */
     this.xd3_decode_finish_window();
+    this.src.xd3_trim_cache();
   };
 
   _XDelta3Decoder.prototype.xd3_alloc = function(length) {
+    if (this.dec_arena) {
+      return this.dec_arena.xd3_arena_alloc(length);
+    }
     return new Uint8Array(length);
   };
 
@@ -530,8 +1998,14 @@
   };
 
   _XDelta3Decoder.prototype.xd3_decode_allocate = function(length) {
-    var bytes =
-        new Uint8Array(this.delta.slice(this.position, this.position + length));
+    var bytes;
+    if (this.dec_arena) {
+      bytes = this.dec_arena.xd3_arena_alloc(length);
+      bytes.set(this.delta.subarray(this.position, this.position + length));
+    } else {
+      bytes = new Uint8Array(
+          this.delta.slice(this.position, this.position + length));
+    }
     this.position += length;
     return bytes;
   };
@@ -549,13 +2023,16 @@
       if (!(aPart & 0x80)) {
         return integer;
       }
-      integer <<= 7;
+      // Multiply rather than shift, a corrupt integer must not go negative.
+      integer *= 128;
     }
     throw new Error('delta integer too long');
   };
 
   /**
-   * The code table.
+   * The code table. The rows are also kept as one typed array per column,
+   * which xd3_decode_instructions dispatches on, so an application code
+   * table decodes as fast as the default one.
    * @param {!Array<xd3_dinst>} tableRows
    * @constructor
    * @struct
@@ -563,307 +2040,3986 @@
   var xd3_dinst_table = function(tableRows) {
     /** @type {!Array<xd3_dinst>} */
     this.tableRows = tableRows;
+
+    /** @type {!Uint8Array} */
+    this.type1 = new Uint8Array(256);
+    /** @type {!Uint8Array} */
+    this.size1 = new Uint8Array(256);
+    /** @type {!Uint8Array} */
+    this.type2 = new Uint8Array(256);
+    /** @type {!Uint8Array} */
+    this.size2 = new Uint8Array(256);
+
+    for (var i = 0; i < 256; i++) {
+      this.type1[i] = tableRows[i].type1;
+      this.size1[i] = tableRows[i].size1;
+      this.type2[i] = tableRows[i].type2;
+      this.size2[i] = tableRows[i].size2;
+    }
   };
 
   /**
-   * xd3_hinst
+   * The instructions of a window decoded into parallel arrays, one entry per
+   * half-instruction.
    * @constructor
+   * @struct
    */
-  function xd3_hinst() {
-    this.type = XD3_NOOP;
-    this.size = 0;
-    this.addr = 0;
+  function xd3_winops() {
+    /** @type {number} */
+    this.count = 0;
+
+    /**
+     * XD3_RUN, XD3_ADD, XD3_SRCCPY or XD3_TGTCPY.
+     * @type {!Uint8Array}
+     */
+    this.type = new Uint8Array(0);
+
+    /** @type {!Uint32Array} */
+    this.size = new Uint32Array(0);
+
+    /**
+     * Where the bytes come from: the data section offset for XD3_RUN and
+     * XD3_ADD, the source offset for XD3_SRCCPY and the target window offset
+     * for XD3_TGTCPY.
+     * @type {!Float64Array}
+     */
+    this.addr = new Float64Array(0);
   }
 
   /**
-   * The code-table double instruction.
-   * @constructor
+   * Empties the list and makes room for at least max entries.
+   * @param {number} max
    */
-  function xd3_dinst() {
-    /** @type {number} */
-    this.type1 = XD3_NOOP;
-    /** @type {number} */
-    this.size1 = 0;
-    /** @type {number} */
-    this.type2 = XD3_NOOP;
-    /** @type {number} */
-    this.size2 = 0;
-  }
+  xd3_winops.prototype.reset = function(max) {
+    if (this.type.length < max) {
+      this.type = new Uint8Array(max);
+      this.size = new Uint32Array(max);
+      this.addr = new Float64Array(max);
+    }
+    this.count = 0;
+  };
 
   /**
-   * @param {!xd3_code_table_desc} desc
-   * @return {!xd3_dinst_table}
-   */
+   * A ring buffer with the last bytes of the target.
+   * @param {number} size
+   * @constructor
+   * @struct
+   */
+  function xd3_history(size) {
+    /** @type {!Uint8Array} */
+    this.bytes = new Uint8Array(size);
+
+    /**
+     * The target length so far.
+     * @type {number}
+     */
+    this.end = 0;
+  }
+
+  /**
+   * Adds target bytes to the end of the history.
+   * @param {!Uint8Array} buf
+   * @param {number} pos
+   * @param {number} len
+   */
+  xd3_history.prototype.xd3_history_append = function(buf, pos, len) {
+    var size = this.bytes.length;
+    this.end += len;
+    if (len > size) {
+      pos += len - size;
+      len = size;
+    }
+    while (len > 0) {
+      var at = (this.end - len) % size;
+      var take = Math.min(len, size - at);
+      xd3_copy_bytes(this.bytes, at, buf, pos, take);
+      pos += take;
+      len -= take;
+    }
+  };
+
+  /**
+   * Copies from the history. The range was checked against the copy window,
+   * which is in the history.
+   * @param {!Uint8Array} out
+   * @param {number} pos
+   * @param {number} from The target offset.
+   * @param {number} len
+   */
+  xd3_history.prototype.xd3_history_copy = function(out, pos, from, len) {
+    var size = this.bytes.length;
+    while (len > 0) {
+      var at = from % size;
+      var take = Math.min(len, size - at);
+      xd3_copy_bytes(out, pos, this.bytes, at, take);
+      pos += take;
+      from += take;
+      len -= take;
+    }
+  };
+
+  /**
+   * One region that the decoder's section, checksum and code table buffers
+   * are taken from instead of being allocated one by one. Allocating moves
+   * pos; the buffers of a window are given back when the next window starts
+   * and reset gives back everything. When a buffer does not fit, a larger
+   * region replaces the current one. The buffers already taken stay valid,
+   * and after the next reset every buffer comes from the larger region.
+   * @param {number} size The initial size, 0 to size the region from the
+   *     first window header.
+   * @constructor
+   * @struct
+   */
+  function xd3_arena(size) {
+    /** @type {!Uint8Array} */
+    this.bytes = new Uint8Array(size);
+
+    /** @type {number} */
+    this.pos = 0;
+
+    /**
+     * Where the buffers of the current window start, after the ones that
+     * last the whole delta.
+     * @type {number}
+     */
+    this.winpos = 0;
+  }
+
+  /**
+   * Gives back all of the buffers.
+   */
+  xd3_arena.prototype.xd3_arena_reset = function() {
+    this.pos = 0;
+    this.winpos = 0;
+  };
+
+  /**
+   * Makes sure that length more bytes fit in the region.
+   * @param {number} length
+   */
+  xd3_arena.prototype.xd3_arena_reserve = function(length) {
+    if (this.pos + length > this.bytes.length) {
+      this.bytes = new Uint8Array(Math.max(2 * this.bytes.length,
+          xd3_round_alloc(this.pos + length)));
+    }
+  };
+
+  /**
+   * @param {number} length
+   * @return {!Uint8Array}
+   */
+  xd3_arena.prototype.xd3_arena_alloc = function(length) {
+    this.xd3_arena_reserve(length);
+    var bytes = this.bytes.subarray(this.pos, this.pos + length);
+    this.pos += length;
+    return bytes;
+  };
+
+  /**
+   * Starts a window: gives back the buffers of the previous one.
+   */
+  xd3_arena.prototype.xd3_arena_window = function() {
+    this.pos = this.winpos;
+  };
+
+  /**
+   * Keeps the buffers taken so far for the rest of the delta.
+   */
+  xd3_arena.prototype.xd3_arena_keep = function() {
+    this.winpos = this.pos;
+  };
+
+  /**
+   * Decoders that are reset for each delta, see createPool.
+   * @param {number} max The most decoders to keep.
+   * @constructor
+   * @struct
+   */
+  function xd3_stream_pool(max) {
+    /** @type {number} */
+    this.max = max;
+
+    /** @type {!Array<!_XDelta3Decoder>} */
+    this.streams = [];
+  }
+
+  /**
+   * @param {!Uint8Array} delta
+   * @param {(Uint8Array|XDelta3Decoder.Source)=} opt_source
+   * @param {number=} opt_flags
+   * @return {!ArrayBuffer}
+   */
+  xd3_stream_pool.prototype.decode = function(delta, opt_source, opt_flags) {
+    if (typeof opt_source != 'object') {
+      opt_source = null;
+    }
+    var xdelta3 = this.xd3_pool_get(delta, opt_source, opt_flags);
+    try {
+      return xdelta3.xd3_decode_input().buffer;
+    } finally {
+      this.xd3_pool_put(xdelta3);
+    }
+  };
+
+  /**
+   * @param {!Uint8Array} delta
+   * @param {(Uint8Array|XDelta3Decoder.Source)} source
+   * @param {!Uint8Array} output
+   * @param {number=} opt_flags
+   * @return {number} The length of the target.
+   */
+  xd3_stream_pool.prototype.decodeInto = function(delta, source, output,
+      opt_flags) {
+    var xdelta3 = this.xd3_pool_get(delta, source, opt_flags);
+    try {
+      return xdelta3.xd3_decode_into(output);
+    } finally {
+      this.xd3_pool_put(xdelta3);
+    }
+  };
+
+  /**
+   * Takes a decoder from the pool, or makes one if the pool is empty.
+   * @param {!Uint8Array} delta
+   * @param {(Uint8Array|XDelta3Decoder.Source)} source
+   * @param {number=} opt_flags
+   * @return {!_XDelta3Decoder}
+   */
+  xd3_stream_pool.prototype.xd3_pool_get = function(delta, source,
+      opt_flags) {
+    var xdelta3 = this.streams.pop();
+    if (xdelta3) {
+      xdelta3.xd3_stream_reset(delta, source, opt_flags);
+    } else {
+      xdelta3 = new _XDelta3Decoder(delta, source, opt_flags);
+      xdelta3.dec_arena = new xd3_arena(0);
+    }
+    return xdelta3;
+  };
+
+  /**
+   * Puts a decoder back, without the delta and the output it was given.
+   * @param {!_XDelta3Decoder} xdelta3
+   */
+  xd3_stream_pool.prototype.xd3_pool_put = function(xdelta3) {
+    if (this.streams.length < this.max) {
+      xdelta3.delta = XD3_EMPTY;
+      xdelta3.dec_buffer = null;
+      this.streams.push(xdelta3);
+    }
+  };
+
+  /**
+   * Rounds up to a multiple of XD3_ALLOCSIZE.
+   * @param {number} length
+   * @return {number}
+   */
+  function xd3_round_alloc(length) {
+    return Math.ceil(length / XD3_ALLOCSIZE) * XD3_ALLOCSIZE;
+  }
+
+  /**
+   * The windows of a delta, as found by xd3_scan_windows. Each array has an
+   * extra entry at count for the end of the last window.
+   * @constructor
+   * @struct
+   */
+  function xd3_winlist() {
+    /** @type {number} */
+    this.count = 0;
+
+    /**
+     * Where each window starts in the delta.
+     * @type {!Array<number>}
+     */
+    this.delta_pos = [];
+
+    /**
+     * Where each target window starts in the output.
+     * @type {!Array<number>}
+     */
+    this.tgt_pos = [];
+
+    /** @type {!Array<number>} */
+    this.win_ind = [];
+
+    /** @type {!Array<number>} */
+    this.cpylen = [];
+
+    /** @type {!Array<number>} */
+    this.cpyoff = [];
+  }
+
+  /**
+   * Finds the window that holds a target offset.
+   * @param {!xd3_winlist} wins
+   * @param {number} offset Less than the target length.
+   * @return {number} The window number.
+   */
+  function xd3_find_window(wins, offset) {
+    var lo = 0;
+    var hi = wins.count - 1;
+    while (lo < hi) {
+      var mid = (lo + hi + 1) >> 1;
+      if (wins.tgt_pos[mid] <= offset) {
+        lo = mid;
+      } else {
+        hi = mid - 1;
+      }
+    }
+    return lo;
+  }
+
+  /**
+   * The window index format written by buildIndex. All numbers are VCDIFF
+   * variable length integers:
+   *   magic          'X' 'D' '3' 'I'
+   *   version        1
+   *   delta length   to catch an index saved for another delta
+   *   header length  where the first window starts
+   *   window count
+   *   per window: win_ind, delta length, target length, cpylen, cpyoff
+   * @type {number}
+   */
+  var XD3_INDEX_VERSION = 1;
+
+  /**
+   * @param {!xd3_winlist} wins
+   * @param {number} delta_len
+   * @return {!Uint8Array}
+   */
+  function xd3_write_index(wins, delta_len) {
+    var bytes = [0x58, 0x44, 0x33, 0x49];
+    xd3_emit_integer(bytes, XD3_INDEX_VERSION);
+    xd3_emit_integer(bytes, delta_len);
+    xd3_emit_integer(bytes, wins.delta_pos[0]);
+    xd3_emit_integer(bytes, wins.count);
+    for (var i = 0; i < wins.count; i++) {
+      xd3_emit_integer(bytes, wins.win_ind[i]);
+      xd3_emit_integer(bytes, wins.delta_pos[i + 1] - wins.delta_pos[i]);
+      xd3_emit_integer(bytes, wins.tgt_pos[i + 1] - wins.tgt_pos[i]);
+      xd3_emit_integer(bytes, wins.cpylen[i]);
+      xd3_emit_integer(bytes, wins.cpyoff[i]);
+    }
+    return new Uint8Array(bytes);
+  }
+
+  /**
+   * @param {!Uint8Array} index From xd3_write_index.
+   * @param {number} delta_len The length of the delta it is used with.
+   * @return {!xd3_winlist}
+   */
+  function xd3_read_index(index, delta_len) {
+    var reader = new DataObject(index);
+    if (index[0] != 0x58 || index[1] != 0x44 || index[2] != 0x33 ||
+        index[3] != 0x49) {
+      throw new Error('invalid index magic');
+    }
+    reader.pos = 4;
+    if (reader.getInteger() != XD3_INDEX_VERSION) {
+      throw new Error('unsupported index version');
+    }
+    if (reader.getInteger() != delta_len) {
+      throw new Error('index does not match delta');
+    }
+    var wins = new xd3_winlist();
+    var delta_pos = reader.getInteger();
+    var tgt_pos = 0;
+    var count = reader.getInteger();
+    for (var i = 0; i < count; i++) {
+      wins.delta_pos.push(delta_pos);
+      wins.tgt_pos.push(tgt_pos);
+      wins.win_ind.push(reader.getInteger());
+      delta_pos += reader.getInteger();
+      tgt_pos += reader.getInteger();
+      wins.cpylen.push(reader.getInteger());
+      wins.cpyoff.push(reader.getInteger());
+    }
+    wins.delta_pos.push(delta_pos);
+    wins.tgt_pos.push(tgt_pos);
+    wins.count = count;
+    if (reader.pos != index.length || delta_pos != delta_len) {
+      throw new Error('index does not match delta');
+    }
+    return wins;
+  }
+
+  /**
+   * Appends a VCDIFF variable length integer.
+   * @param {!Array<number>} bytes
+   * @param {number} val
+   */
+  function xd3_emit_integer(bytes, val) {
+    var digits = [val % 128];
+    val = Math.floor(val / 128);
+    while (val > 0) {
+      digits.unshift(0x80 | (val % 128));
+      val = Math.floor(val / 128);
+    }
+    for (var i = 0; i < digits.length; i++) {
+      bytes.push(digits[i]);
+    }
+  }
+
+  /**
+   * Splits the windows into at most n contiguous runs with about the same
+   * target size. VCD_TARGET windows copy from earlier output, which may be
+   * in another run, so a delta with any of them is not split.
+   * @param {!xd3_winlist} wins
+   * @param {number} n
+   * @return {!Array<number>} The first window of each run, then wins.count.
+   */
+  function xd3_split_windows(wins, n) {
+    var groups = [0];
+    var per_group = wins.tgt_pos[wins.count] / n;
+    if (per_group == 0) {
+      return [0, wins.count];
+    }
+    for (var i = 1; i < wins.count; i++) {
+      if (wins.win_ind[i] & VCD_TARGET) {
+        return [0, wins.count];
+      }
+      /* Empty windows at the end are at the total size, which would start
+       * one run too many. */
+      if (groups.length < n && wins.tgt_pos[i] >= per_group * groups.length) {
+        groups.push(i);
+      }
+    }
+    groups.push(wins.count);
+    return groups;
+  }
+
+  /**
+   * Readies a source to be posted to workers: a fileSource becomes its File
+   * and a Uint8Array is copied once into a SharedArrayBuffer if shared.
+   * @param {Uint8Array|XDelta3Decoder.Source} source A Uint8Array, a
+   *     fileSource or null.
+   * @param {boolean} shared
+   * @return {?Uint8Array|{file: !Blob, blksize: number,
+   *     max_blocks: (number|undefined)}}
+   */
+  function xd3_worker_source(source, shared) {
+    if (source && source.file) {
+      return {file: source.file, blksize: source.blksize,
+              max_blocks: source.max_blocks};
+    }
+    if (shared && source) {
+      var shared_source = new Uint8Array(new SharedArrayBuffer(source.length));
+      shared_source.set(source);
+      return shared_source;
+    }
+    return /** @type {?Uint8Array} */ (source);
+  }
+
+  /**
+   * Turns a source posted by xd3_worker_source back into a decoder source.
+   * @param {*} source
+   * @return {Uint8Array|XDelta3Decoder.Source}
+   */
+  function xd3_posted_source(source) {
+    if (source && source.file) {
+      return XDelta3Decoder.fileSource(source.file, source.blksize,
+          source.max_blocks);
+    }
+    return /** @type {Uint8Array} */ (source);
+  }
+
+  /**
+   * Starts a worker for each run of windows and resolves with the output
+   * once they have all finished.
+   * @param {!Uint8Array} delta
+   * @param {Uint8Array|XDelta3Decoder.Source} source A Uint8Array or a
+   *     fileSource.
+   * @param {{workerUrl: string, flags: (number|undefined)}} options
+   * @param {!xd3_winlist} wins
+   * @param {!Array<number>} groups From xd3_split_windows.
+   * @param {function(!ArrayBuffer|!SharedArrayBuffer)} resolve
+   * @param {function(!Error)} reject
+   */
+  function xd3_decode_workers(delta, source, options, wins, groups, resolve,
+      reject) {
+    var shared = typeof SharedArrayBuffer == 'function' &&
+        window.crossOriginIsolated !== false;
+    var tgtsize = wins.tgt_pos[wins.count];
+    var output = shared ? new SharedArrayBuffer(tgtsize) :
+        new ArrayBuffer(tgtsize);
+    source = xd3_worker_source(source, shared);
+    var hdrlen = wins.delta_pos[0];
+    var pending = groups.length - 1;
+    var workers = [];
+    var failed = false;
+
+    var finish = function(error) {
+      if (failed) {
+        return;
+      }
+      if (error) {
+        failed = true;
+        workers.forEach(function(worker) { worker.terminate(); });
+        reject(error);
+      } else if (--pending == 0) {
+        resolve(output);
+      }
+    };
+
+    for (var g = 0; g + 1 < groups.length; g++) {
+      var begin = wins.delta_pos[groups[g]];
+      var end = wins.delta_pos[groups[g + 1]];
+      var outpos = wins.tgt_pos[groups[g]];
+      var outlen = wins.tgt_pos[groups[g + 1]] - outpos;
+
+      // The worker gets the header and its own windows.
+      var part = new Uint8Array(hdrlen + end - begin);
+      part.set(delta.subarray(0, hdrlen));
+      part.set(delta.subarray(begin, end), hdrlen);
+
+      var worker = new Worker(options.workerUrl, {name: XD3_WORKER_NAME});
+      worker.onmessage = (function(worker, outpos) {
+        return function(e) {
+          worker.terminate();
+          if (e.data.error) {
+            finish(new Error(e.data.error));
+            return;
+          }
+          if (e.data.bytes) {
+            new Uint8Array(output, outpos).set(new Uint8Array(e.data.bytes));
+          }
+          finish(null);
+        };
+      })(worker, outpos);
+      worker.onerror = function(e) {
+        finish(new Error(e.message));
+      };
+      workers.push(worker);
+      worker.postMessage({
+        delta: part,
+        source: source,
+        flags: options.flags || 0,
+        zstd_dicts: Object.keys(xd3_zstd_dicts).map(function(id) {
+          return xd3_zstd_dicts[id].bytes;
+        }),
+        output: shared ? output : null,
+        outpos: outpos,
+        outlen: outlen
+      }, [part.buffer]);
+    }
+  }
+
+  /**
+   * Decodes one delta of a batch.
+   * @param {!xd3_stream_pool} pool
+   * @param {Uint8Array|XDelta3Decoder.Source} source
+   * @param {!Uint8Array} delta
+   * @param {?Uint8Array} output Where the target goes, or null for a new
+   *     buffer.
+   * @param {number=} opt_flags
+   * @return {{target: ?Uint8Array, length: number, error: ?string}}
+   */
+  function xd3_batch_decode(pool, source, delta, output, opt_flags) {
+    try {
+      if (output) {
+        var length = pool.decodeInto(delta, source, output, opt_flags);
+        return {target: output.subarray(0, length), length: length,
+                error: null};
+      }
+      var target = new Uint8Array(pool.decode(delta, source, opt_flags));
+      return {target: target, length: target.length, error: null};
+    } catch (e) {
+      return {target: null, length: 0, error: e.message};
+    }
+  }
+
+  /**
+   * @param {!Array<{target: ?Uint8Array, length: number, error: ?string}>}
+   *     results
+   * @param {number} millis
+   * @return {!XDelta3Decoder.BatchResult}
+   */
+  function xd3_batch_report(results, millis) {
+    var bytes = 0;
+    var failed = 0;
+    for (var i = 0; i < results.length; i++) {
+      bytes += results[i].length;
+      if (results[i].error) {
+        failed++;
+      }
+    }
+    return {results: results, failed: failed, bytes: bytes, millis: millis,
+            mbPerSec: millis > 0 ? (bytes / (1 << 20)) / (millis / 1000) : 0};
+  }
+
+  /**
+   * @return {number} Milliseconds, for the batch throughput.
+   */
+  function xd3_now() {
+    return (typeof performance != 'undefined') ? performance.now() :
+        Date.now();
+  }
+
+  /**
+   * Starts a worker for each run of items and resolves with the report once
+   * they have all finished.
+   * @param {Uint8Array|XDelta3Decoder.Source} source A Uint8Array, a
+   *     fileSource or null.
+   * @param {!Array<!XDelta3Decoder.BatchItem>} items
+   * @param {{workerUrl: string, flags: (number|undefined)}} options
+   * @param {number} n The number of workers.
+   * @param {function(!XDelta3Decoder.BatchResult)} resolve
+   * @param {function(!Error)} reject
+   */
+  function xd3_batch_workers(source, items, options, n, resolve, reject) {
+    var startTime = xd3_now();
+    var shared = typeof SharedArrayBuffer == 'function' &&
+        window.crossOriginIsolated !== false;
+    source = xd3_worker_source(source, shared);
+
+    // Split the items by their delta bytes.
+    var total = 0;
+    for (var i = 0; i < items.length; i++) {
+      total += items[i].delta.length;
+    }
+    var groups = [0];
+    var bytes = 0;
+    for (var i = 0; i < items.length; i++) {
+      if (bytes >= total / n * groups.length && groups.length < n) {
+        groups.push(i);
+      }
+      bytes += items[i].delta.length;
+    }
+    groups.push(items.length);
+
+    var results = new Array(items.length);
+    var pending = groups.length - 1;
+    var workers = [];
+    var failed = false;
+
+    var finish = function(error) {
+      if (failed) {
+        return;
+      }
+      if (error) {
+        failed = true;
+        workers.forEach(function(worker) { worker.terminate(); });
+        reject(error);
+      } else if (--pending == 0) {
+        resolve(xd3_batch_report(results, xd3_now() - startTime));
+      }
+    };
+
+    for (var g = 0; g + 1 < groups.length; g++) {
+      var worker = new Worker(options.workerUrl, {name: XD3_WORKER_NAME});
+      worker.onmessage = (function(worker, first) {
+        return function(e) {
+          worker.terminate();
+          if (e.data.error) {
+            finish(new Error(e.data.error));
+            return;
+          }
+          e.data.results.forEach(function(result, i) {
+            results[first + i] = xd3_batch_result(items[first + i], result);
+          });
+          finish(null);
+        };
+      })(worker, groups[g]);
+      worker.onerror = function(e) {
+        finish(new Error(e.message));
+      };
+      workers.push(worker);
+      var deltas = [];
+      for (var i = groups[g]; i < groups[g + 1]; i++) {
+        deltas.push(items[i].delta);
+      }
+      worker.postMessage({
+        batch: deltas,
+        source: source,
+        flags: options.flags || 0,
+        zstd_dicts: Object.keys(xd3_zstd_dicts).map(function(id) {
+          return xd3_zstd_dicts[id].bytes;
+        })
+      });
+    }
+  }
+
+  /**
+   * Places the target a batch worker sent for an item.
+   * @param {!XDelta3Decoder.BatchItem} item
+   * @param {{bytes: ?ArrayBuffer, error: ?string}} result
+   * @return {{target: ?Uint8Array, length: number, error: ?string}}
+   */
+  function xd3_batch_result(item, result) {
+    if (result.error) {
+      return {target: null, length: 0, error: result.error};
+    }
+    var target = new Uint8Array(result.bytes);
+    if (item.output) {
+      if (target.length > item.output.length) {
+        return {target: null, length: 0,
+                error: 'target exceeds output buffer'};
+      }
+      item.output.set(target);
+      target = item.output.subarray(0, target.length);
+    }
+    return {target: target, length: target.length, error: null};
+  }
+
+  /**
+   * The worker side of xd3_batch_workers.
+   * @param {{batch: !Array<!Uint8Array>, source: *, flags: number}} msg
+   */
+  function xd3_batch_worker(msg) {
+    var pool = new xd3_stream_pool(1);
+    var source = xd3_posted_source(msg.source);
+    var results = [];
+    var transfer = [];
+    for (var i = 0; i < msg.batch.length; i++) {
+      var result = xd3_batch_decode(pool, source, msg.batch[i], null,
+          msg.flags);
+      results.push({bytes: result.target ? result.target.buffer : null,
+                    error: result.error});
+      if (result.target) {
+        transfer.push(result.target.buffer);
+      }
+    }
+    window.postMessage({results: results}, transfer);
+  }
+
+  /**
+   * Starts a worker for each delta of a chain and resolves with the last
+   * target once every worker has finished. Each window of an intermediate
+   * target is passed on from the worker that makes it to the next one,
+   * which drops it after the last of its windows that copies from it, see
+   * xd3_chain_plan.
+   * @param {Uint8Array|XDelta3Decoder.Source} source A Uint8Array, a
+   *     fileSource or null.
+   * @param {!Array<!Uint8Array>} deltas
+   * @param {{workerUrl: string, flags: (number|undefined),
+   *     ahead: (number|undefined), stats: (!Array<!Object>|undefined)}}
+   *     options
+   * @param {function(!ArrayBuffer)} resolve
+   * @param {function(!Error)} reject
+   */
+  function xd3_decode_chain_workers(source, deltas, options, resolve,
+      reject) {
+    var wins = deltas.map(function(delta) {
+      var xdelta3 = new _XDelta3Decoder(delta, null);
+      xdelta3.xd3_decode_header();
+      return xdelta3.xd3_scan_windows();
+    });
+    var last = deltas.length - 1;
+    var workers = [];
+    var finished = false;
+    var running = deltas.length;
+    var target = null;
+
+    var finish = function(error, target) {
+      if (finished) {
+        return;
+      }
+      finished = true;
+      workers.forEach(function(worker) { worker.terminate(); });
+      if (error) {
+        reject(error);
+      } else {
+        resolve(target);
+      }
+    };
+
+    for (var hop = 0; hop <= last; hop++) {
+      var worker = new Worker(options.workerUrl, {name: XD3_WORKER_NAME});
+      worker.onmessage = (function(hop) {
+        return function(e) {
+          var msg = e.data;
+          if (msg.error) {
+            finish(new Error(msg.error));
+          } else if (msg.chain_window) {
+            workers[hop + 1].postMessage({chain_window: msg.chain_window},
+                [msg.chain_window]);
+          } else if (msg.chain_demand !== undefined ||
+                     msg.chain_released !== undefined) {
+            workers[hop - 1].postMessage(msg);
+          } else if (msg.chain_done) {
+            if (options.stats) {
+              options.stats[hop] = msg.chain_done;
+            }
+            if (hop == last) {
+              target = msg.bytes;
+            }
+            if (--running == 0) {
+              finish(null, target);
+            }
+          }
+        };
+      })(hop);
+      worker.onerror = function(e) {
+        finish(new Error(e.message));
+      };
+      workers.push(worker);
+    }
+    for (hop = 0; hop <= last; hop++) {
+      var plan = hop ? xd3_chain_plan(wins[hop - 1], wins[hop]) : null;
+      workers[hop].postMessage({
+        chain: hop,
+        last: hop == last,
+        delta: deltas[hop],
+        source: hop ? null : xd3_worker_source(source, false),
+        input_ends: hop ? wins[hop - 1].tgt_pos : null,
+        need: plan ? plan.need : null,
+        last_use: plan ? plan.last_use : null,
+        history: xd3_chain_history(wins[hop]),
+        ahead: options.ahead || XD3_CHAIN_AHEAD,
+        flags: options.flags || 0,
+        zstd_dicts: Object.keys(xd3_zstd_dicts).map(function(id) {
+          return xd3_zstd_dicts[id].bytes;
+        })
+      });
+    }
+  }
+
+  /**
+   * The block size of the source that a chain worker builds from the
+   * windows of the worker before it.
+   * @type {number}
+   */
+  var XD3_CHAIN_BLKSIZE = 1 << 16;
+
+  /**
+   * The default of how many bytes of its target a chain worker makes ahead
+   * of the next worker, which has not dropped them yet.
+   * @type {number}
+   */
+  var XD3_CHAIN_AHEAD = 1 << 23;
+
+  /**
+   * Which windows of the previous target each window of a delta needs: the
+   * windows under the source blocks its VCD_SOURCE copy window is in.
+   * @param {!xd3_winlist} input The windows of the previous target.
+   * @param {!xd3_winlist} wins The windows of the delta.
+   * @return {{need: !Array<number>, last_use: !Array<number>}} The last
+   *     input window each window needs, or -1, and the last window that
+   *     needs each input window, or -1.
+   */
+  function xd3_chain_plan(input, wins) {
+    var size = input.tgt_pos[input.count];
+    var need = [];
+    var last_use = [];
+    for (var j = 0; j < input.count; j++) {
+      last_use.push(-1);
+    }
+    for (var i = 0; i < wins.count; i++) {
+      need.push(-1);
+      var start = Math.floor(wins.cpyoff[i] / XD3_CHAIN_BLKSIZE) *
+          XD3_CHAIN_BLKSIZE;
+      if (!(wins.win_ind[i] & VCD_SOURCE) || wins.cpylen[i] == 0 ||
+          start >= size) {
+        /* A copy window past the end fails without reading the source. */
+        continue;
+      }
+      var end = Math.min(size, Math.ceil((wins.cpyoff[i] + wins.cpylen[i]) /
+          XD3_CHAIN_BLKSIZE) * XD3_CHAIN_BLKSIZE);
+      need[i] = xd3_find_window(input, end - 1);
+      for (j = xd3_find_window(input, start); j <= need[i]; j++) {
+        last_use[j] = i;
+      }
+    }
+    return {need: need, last_use: last_use};
+  }
+
+  /**
+   * @param {!xd3_winlist} wins
+   * @return {number} How far back the VCD_TARGET windows of a delta copy
+   *     from, the history a worker that does not keep its target needs.
+   */
+  function xd3_chain_history(wins) {
+    var history = 0;
+    for (var i = 0; i < wins.count; i++) {
+      if (wins.win_ind[i] & VCD_TARGET) {
+        history = Math.max(history, wins.tgt_pos[i] - wins.cpyoff[i]);
+      }
+    }
+    return history;
+  }
+
+  /**
+   * The worker side of xd3_decode_chain_workers. A window is decoded once
+   * the windows of the previous target that it needs have come, and unless
+   * the next worker holds options.ahead bytes or more of this target and
+   * has not asked for the window. Without the windows it needs, the worker
+   * asks the previous worker for them.
+   * @param {{chain: number, last: boolean, delta: !Uint8Array, source: *,
+   *     input_ends: ?Array<number>, need: ?Array<number>,
+   *     last_use: ?Array<number>, history: number, ahead: number,
+   *     flags: number}} msg
+   * @constructor
+   * @struct
+   */
+  function xd3_chain_worker(msg) {
+    var self = this;
+    this.msg = msg;
+    this.ends = msg.input_ends;
+
+    /**
+     * The windows of the previous target that have come, null once dropped.
+     * @type {!Array<?Uint8Array>}
+     */
+    this.inputs = [];
+    this.demanded = -1;
+
+    /**
+     * The windows of the previous target to drop after each window of this
+     * one, from msg.last_use.
+     * @type {!Array<!Array<number>>}
+     */
+    this.releases = [];
+
+    /**
+     * The highest window of this target that the next worker waits for.
+     * @type {number}
+     */
+    this.demand = -1;
+
+    /**
+     * The bytes of this target that the next worker holds.
+     * @type {number}
+     */
+    this.held = 0;
+
+    var source = msg.input_ends ? {
+      size: msg.input_ends[msg.input_ends.length - 1],
+      blksize: XD3_CHAIN_BLKSIZE,
+      getblk: function(blkno) {
+        return self.xd3_chain_block(blkno);
+      }
+    } : xd3_posted_source(msg.source);
+    this.xdelta3 = new _XDelta3Decoder(msg.delta, source, msg.flags);
+    this.xdelta3.xd3_decode_header();
+    var wins = this.xdelta3.xd3_scan_windows();
+    this.count = wins.count;
+    this.done = 0;
+
+    /**
+     * Whether every window is done and every input window has come.
+     * @type {boolean}
+     */
+    this.finished = false;
+    for (var i = 0; i < this.count; i++) {
+      this.releases.push([]);
+    }
+    if (msg.last_use) {
+      for (var w = 0; w < msg.last_use.length; w++) {
+        if (msg.last_use[w] >= 0) {
+          this.releases[msg.last_use[w]].push(w);
+        }
+      }
+    }
+
+    /**
+     * What the page gets in options.stats once this worker is done.
+     * @type {{hits: number, misses: number, released: number,
+     *     stale: number}}
+     */
+    this.stats = {hits: 0, misses: 0, released: 0, stale: 0};
+    if (msg.last) {
+      this.output = new Uint8Array(wins.tgt_pos[wins.count]);
+      this.xdelta3.xd3_set_output(this.output);
+    } else {
+      this.output = null;
+      this.xdelta3.xd3_set_output(null);
+      this.xdelta3.dec_getwin = function(winno, offset, length) {
+        return new Uint8Array(length);
+      };
+      this.xdelta3.dec_history = new xd3_history(msg.history);
+    }
+  }
+
+  /**
+   * A source block of the previous target, a view of the window it is in
+   * or a copy of the windows it spans.
+   * @param {number} blkno
+   * @return {!Uint8Array}
+   */
+  xd3_chain_worker.prototype.xd3_chain_block = function(blkno) {
+    var ends = this.ends;
+    var start = blkno * XD3_CHAIN_BLKSIZE;
+    var end = Math.min(start + XD3_CHAIN_BLKSIZE, ends[ends.length - 1]);
+    var wins = {count: ends.length - 1, tgt_pos: ends};
+    var w = xd3_find_window(wins, start);
+    if (ends[w + 1] >= end && this.inputs[w]) {
+      return this.inputs[w].subarray(start - ends[w], end - ends[w]);
+    }
+    var block = new Uint8Array(end - start);
+    for (var pos = start; pos < end; w++) {
+      var take = Math.min(end, ends[w + 1]) - pos;
+      if (!this.inputs[w]) {
+        throw new Error('chain source window ' + w + ' is not kept');
+      }
+      block.set(this.inputs[w].subarray(pos - ends[w], pos - ends[w] + take),
+          pos - start);
+      pos += take;
+    }
+    return block;
+  };
+
+  /**
+   * Handles a message from the other workers, through the page.
+   * @param {{chain_window: (!ArrayBuffer|undefined),
+   *     chain_demand: (number|undefined),
+   *     chain_released: (number|undefined)}} msg
+   */
+  xd3_chain_worker.prototype.xd3_chain_message = function(msg) {
+    if (msg.chain_window) {
+      var w = this.inputs.length;
+      this.inputs.push(new Uint8Array(msg.chain_window));
+      if (this.msg.last_use[w] < this.done) {
+        this.xd3_chain_release(w);
+      }
+    } else if (msg.chain_demand !== undefined) {
+      this.demand = Math.max(this.demand, msg.chain_demand);
+    } else {
+      this.held -= msg.chain_released;
+    }
+    this.xd3_chain_run();
+  };
+
+  /**
+   * Drops a window of the previous target, along with the cached source
+   * blocks that are views of it or copies of part of it. Any cached block
+   * still in its buffer afterwards is counted in stats.stale.
+   * @param {number} w
+   */
+  xd3_chain_worker.prototype.xd3_chain_release = function(w) {
+    var bytes = this.inputs[w];
+    this.inputs[w] = null;
+    var src = this.xdelta3.src;
+    if (bytes.length) {
+      src.xd3_drop_blocks(Math.floor(this.ends[w] / XD3_CHAIN_BLKSIZE),
+          Math.floor((this.ends[w + 1] - 1) / XD3_CHAIN_BLKSIZE));
+    }
+    src.blkcache.forEach(function(blk) {
+      if (blk.buffer == bytes.buffer) {
+        this.stats.stale++;
+      }
+    }, this);
+    if (src.curblk && src.curblk.buffer == bytes.buffer) {
+      this.stats.stale++;
+    }
+    this.stats.released++;
+    window.postMessage({chain_released: bytes.length});
+  };
+
+  /**
+   * Decodes the windows that can be decoded now.
+   */
+  xd3_chain_worker.prototype.xd3_chain_run = function() {
+    var xdelta3 = this.xdelta3;
+    var msg = this.msg;
+    while (this.done < this.count) {
+      var need = msg.need ? msg.need[this.done] : -1;
+      if (need >= this.inputs.length) {
+        if (need > this.demanded) {
+          this.demanded = need;
+          window.postMessage({chain_demand: need});
+        }
+        return;
+      }
+      if (!msg.last && this.held >= msg.ahead && this.done > this.demand) {
+        return;
+      }
+      xdelta3.handleWindow();
+      xdelta3.xd3_decode_emit();
+      if (!msg.last) {
+        var bytes = xdelta3.dec_buffer.bytes;
+        this.held += bytes.length;
+        window.postMessage({chain_window: bytes.buffer}, [bytes.buffer]);
+      }
+      var releases = this.releases[this.done];
+      for (var i = 0; i < releases.length; i++) {
+        this.xd3_chain_release(releases[i]);
+      }
+      this.done++;
+    }
+    /* The windows of the previous target that no window needs still come,
+     * and are dropped as they do. */
+    if (!this.finished && (!this.ends ||
+        this.inputs.length == this.ends.length - 1)) {
+      this.finished = true;
+      this.xd3_chain_finish();
+    }
+  };
+
+  /**
+   * Tells the page that this worker is done, with the last target.
+   */
+  xd3_chain_worker.prototype.xd3_chain_finish = function() {
+    var src = this.xdelta3.src;
+    this.stats.hits = src.stats.hits;
+    this.stats.misses = src.stats.misses;
+    if (this.output) {
+      window.postMessage({chain_done: this.stats, bytes: this.output.buffer},
+          [this.output.buffer]);
+    } else {
+      window.postMessage({chain_done: this.stats});
+    }
+  };
+
+  /**
+   * The chain of this worker, see xd3_worker_onmessage.
+   * @type {?xd3_chain_worker}
+   */
+  var xd3_chain_current = null;
+
+  /**
+   * The sections that xd3_decode_section_workers workers have decompressed,
+   * until the window that uses them takes them.
+   * @param {!Array<!Array<?Uint8Array>>} sections From xd3_find_sections.
+   * @constructor
+   * @struct
+   */
+  function xd3_secpipe(sections) {
+    /**
+     * The compressed sections, by section type and window.
+     * @type {!Array<!Array<?Uint8Array>>}
+     */
+    this.sections = sections;
+
+    /**
+     * The decompressed sections, or the Error decompressing them.
+     * @type {!Array<!Array<!Uint8Array|!Error|undefined>>}
+     */
+    this.ready = [[], [], []];
+  }
+
+  /**
+   * @param {number} win
+   * @return {boolean} Whether the compressed sections of a window are done.
+   */
+  xd3_secpipe.prototype.has = function(win) {
+    for (var which = 0; which < 3; which++) {
+      if (this.sections[which][win] && !this.ready[which][win]) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  /**
+   * @param {number} which
+   * @param {number} win
+   * @return {!Uint8Array} The decompressed section.
+   */
+  xd3_secpipe.prototype.take = function(which, win) {
+    var bytes = this.ready[which][win];
+    if (!bytes) {
+      // The window marks a section that the scan did not.
+      throw new Error('secondary section not decompressed');
+    }
+    if (bytes instanceof Error) {
+      throw bytes;
+    }
+    this.ready[which][win] = undefined;
+    return bytes;
+  };
+
+  /**
+   * Decodes a delta whose windows are not split between workers, with
+   * workers decompressing its secondary sections. Each section type is
+   * decompressed in window order by one worker, which keeps the compressor
+   * state of that type like sec_streams. There are at most three workers,
+   * one per section type the delta compresses; fewer workers take several
+   * types each. This thread executes a window as soon as its sections are
+   * done, while the workers go on with the next windows.
+   * @param {!_XDelta3Decoder} xdelta3 With the header decoded.
+   * @param {!xd3_winlist} wins
+   * @param {number} nworkers
+   * @param {string} workerUrl
+   * @param {function(): !ArrayBuffer} serial Decodes without the workers,
+   *     if they do not know the compressor.
+   * @param {function(!ArrayBuffer)} resolve
+   * @param {function(!Error)} reject
+   */
+  function xd3_decode_section_workers(xdelta3, wins, nworkers, workerUrl,
+      serial, resolve, reject) {
+    var sections = xdelta3.xd3_find_sections(wins);
+    var types = [];
+    for (var which = 0; which < 3; which++) {
+      if (sections[which].some(Boolean)) {
+        types.push(which);
+      }
+    }
+    var pipe = new xd3_secpipe(sections);
+    var output = new Uint8Array(wins.tgt_pos[wins.count]);
+    var workers = [];
+    var done = false;
+
+    var finish = function(error, opt_result) {
+      if (done) {
+        return;
+      }
+      done = true;
+      workers.forEach(function(worker) { worker.terminate(); });
+      if (error) {
+        reject(error);
+      } else {
+        resolve(opt_result);
+      }
+    };
+
+    // Executes the windows whose sections are done.
+    var step = function() {
+      try {
+        while (xdelta3.position < xdelta3.delta.length) {
+          if (!pipe.has(xdelta3.dec_window_count)) {
+            return;
+          }
+          xdelta3.handleWindow();
+          xdelta3.xd3_decode_emit();
+        }
+      } catch (e) {
+        finish(e);
+        return;
+      }
+      finish(null, output.buffer);
+    };
+
+    var onmessage = function(e) {
+      if (done) {
+        return;
+      }
+      var msg = e.data;
+      if (msg.unknown) {
+        try {
+          finish(null, serial());
+        } catch (ex) {
+          finish(ex);
+        }
+        return;
+      }
+      if (msg.which === undefined) {
+        finish(new Error(msg.error));
+        return;
+      }
+      pipe.ready[msg.which][msg.win] = msg.error ? new Error(msg.error) :
+          new Uint8Array(msg.bytes);
+      step();
+    };
+
+    xdelta3.dec_secpipe = pipe;
+    xdelta3.xd3_set_output(output);
+    var nsec = Math.min(Math.max(nworkers, 1), types.length);
+    var zstd_dicts = Object.keys(xd3_zstd_dicts).map(function(id) {
+      return xd3_zstd_dicts[id].bytes;
+    });
+    for (var w = 0; w < nsec; w++) {
+      var msg = {sec_id: xdelta3.dec_secondid, count: wins.count,
+                 zstd_dicts: zstd_dicts, sections: []};
+      var transfer = [];
+      for (var t = w; t < types.length; t += nsec) {
+        msg.sections.push({which: types[t], bytes: sections[types[t]]});
+        sections[types[t]].forEach(function(bytes) {
+          if (bytes) {
+            transfer.push(bytes.buffer);
+          }
+        });
+      }
+      var worker = new Worker(workerUrl, {name: XD3_WORKER_NAME});
+      worker.onmessage = onmessage;
+      worker.onerror = function(e) {
+        finish(new Error(e.message));
+      };
+      workers.push(worker);
+      worker.postMessage(msg, transfer);
+    }
+    // The windows without compressed sections need no worker.
+    step();
+  }
+
+  /**
+   * The worker side of xd3_decode_section_workers. Posts each section as
+   * soon as it is decompressed.
+   * @param {{sec_id: number, count: number,
+   *     sections: !Array<{which: number, bytes: !Array<?Uint8Array>}>}} msg
+   */
+  function xd3_section_worker(msg) {
+    var type = xd3_sec_types[msg.sec_id];
+    if (!type) {
+      window.postMessage({unknown: true});
+      return;
+    }
+    var states = msg.sections.map(function() {
+      return type.alloc();
+    });
+    for (var win = 0; win < msg.count; win++) {
+      for (var i = 0; i < msg.sections.length; i++) {
+        var which = msg.sections[i].which;
+        var bytes = msg.sections[i].bytes[win];
+        if (!bytes || !states[i]) {
+          continue;
+        }
+        try {
+          var output = xd3_decode_secondary_bytes(type, states[i], bytes);
+          window.postMessage({which: which, win: win, bytes: output.buffer},
+              [output.buffer]);
+        } catch (ex) {
+          // Later sections of this type depend on this one.
+          window.postMessage({which: which, win: win, error: ex.message});
+          states[i] = null;
+        }
+      }
+    }
+  }
+
+  /**
+   * The worker side of xd3_decode_workers.
+   * @param {!MessageEvent} e
+   */
+  function xd3_worker_onmessage(e) {
+    var msg = e.data;
+    try {
+      if (msg.zstd_dicts === undefined) {
+        xd3_chain_current.xd3_chain_message(msg);
+        return;
+      }
+      msg.zstd_dicts.forEach(XDelta3Decoder.addZstdDictionary);
+      if (msg.sections) {
+        xd3_section_worker(msg);
+        return;
+      }
+      if (msg.batch) {
+        xd3_batch_worker(msg);
+        return;
+      }
+      if (msg.chain !== undefined) {
+        xd3_chain_current = new xd3_chain_worker(msg);
+        xd3_chain_current.xd3_chain_run();
+        return;
+      }
+      var source = xd3_posted_source(msg.source);
+      var xdelta3 = new _XDelta3Decoder(msg.delta, source, msg.flags);
+      xdelta3.xd3_decode_header();
+      if (msg.output) {
+        xdelta3.xd3_decode_windows(
+            new Uint8Array(msg.output, msg.outpos, msg.outlen));
+        window.postMessage({});
+      } else {
+        var bytes = xdelta3.xd3_decode_windows(new Uint8Array(msg.outlen));
+        window.postMessage({bytes: bytes.buffer}, [bytes.buffer]);
+      }
+    } catch (ex) {
+      window.postMessage({error: ex.message});
+    }
+  }
+
+  /**
+   * A source whose bytes are not read, for xd3_walk_windows.
+   * @param {number} size
+   * @return {!XDelta3Decoder.Source}
+   */
+  function xd3_unread_source(size) {
+    return {size: size, blksize: XD3_DEFAULT_SRCBLKSZ};
+  }
+
+  /**
+   * The statistics of analyze, see XDelta3Decoder.DeltaStats.
+   * @param {!xd3_addr_cache} acache For the number of address modes.
+   * @constructor
+   * @struct
+   */
+  function xd3_delta_stats(acache) {
+    this.target = 0;
+    this.delta = 0;
+    this.run = {count: 0, bytes: 0};
+    this.add = {count: 0, bytes: 0};
+    this.sourceCopy = {count: 0, bytes: 0};
+    this.targetCopy = {count: 0, bytes: 0};
+    /** @type {!Array<number>} */
+    this.sourceDistance = [];
+    /** @type {!Array<number>} */
+    this.targetDistance = [];
+    this.modes = {self: 0, here: 0,
+                  near: new Array(acache.s_near).fill(0),
+                  same: new Array(acache.s_same).fill(0)};
+    this.sections = {data: {size: 0, stored: 0}, inst: {size: 0, stored: 0},
+                     addr: {size: 0, stored: 0}};
+  }
+
+  /**
+   * The number of distance histogram entries, enough for any offset.
+   * @type {number}
+   */
+  var XD3_DISTANCE_BITS = 54;
+
+  /**
+   * The histogram entry of a copy distance, floor(log2(distance)) but 0 for
+   * 0.
+   * @param {number} distance
+   * @return {number}
+   */
+  function xd3_distance_bits(distance) {
+    return (distance < 0x80000000) ? 31 - Math.clz32(distance | 1) :
+        Math.floor(Math.log2(distance));
+  }
+
+  /**
+   * Copies counts into a histogram of XDelta3Decoder.DeltaStats, without
+   * the empty entries at the end.
+   * @param {!Array<number>} histogram
+   * @param {!Float64Array} counts
+   */
+  function xd3_set_histogram(histogram, counts) {
+    var end = counts.length;
+    while (end > 0 && counts[end - 1] == 0) {
+      end--;
+    }
+    for (var i = 0; i < end; i++) {
+      histogram[i] = counts[i];
+    }
+  }
+
+  /**
+   * Fills in the statistics of the window whose instructions xd3_walk_windows
+   * has decoded, and clears the mode counts for the next window.
+   * @param {!_XDelta3Decoder} xdelta3
+   * @param {!xd3_delta_stats} stats
+   * @param {number} length The length of the window in the delta.
+   */
+  function xd3_window_stats(xdelta3, stats, length) {
+    var ops = xdelta3.dec_ops;
+    var winstart = xdelta3.dec_winstart;
+    /* The count and the bytes of each instruction type, then the source and
+     * target copy distance histograms. */
+    var counts = new Float64Array(XD3_OLDCPY + 1);
+    var bytes = new Float64Array(XD3_OLDCPY + 1);
+    var srcdist = new Float64Array(XD3_DISTANCE_BITS);
+    var tgtdist = new Float64Array(XD3_DISTANCE_BITS);
+    var pos = 0;
+    for (var i = 0; i < ops.count; i++) {
+      var type = ops.type[i];
+      var size = ops.size[i];
+      var from = ops.addr[i];
+      if (type == XD3_SRCCPY) {
+        srcdist[xd3_distance_bits(Math.abs(winstart + pos - from))]++;
+      } else if (type == XD3_TGTCPY) {
+        tgtdist[xd3_distance_bits(pos - from)]++;
+      } else if (type == XD3_OLDCPY) {
+        tgtdist[xd3_distance_bits(winstart + pos - from)]++;
+      }
+      counts[type]++;
+      bytes[type] += size;
+      pos += size;
+    }
+    stats.run.count = counts[XD3_RUN];
+    stats.run.bytes = bytes[XD3_RUN];
+    stats.add.count = counts[XD3_ADD];
+    stats.add.bytes = bytes[XD3_ADD];
+    stats.sourceCopy.count = counts[XD3_SRCCPY];
+    stats.sourceCopy.bytes = bytes[XD3_SRCCPY];
+    stats.targetCopy.count = counts[XD3_TGTCPY] + counts[XD3_OLDCPY];
+    stats.targetCopy.bytes = bytes[XD3_TGTCPY] + bytes[XD3_OLDCPY];
+    xd3_set_histogram(stats.sourceDistance, srcdist);
+    xd3_set_histogram(stats.targetDistance, tgtdist);
+    stats.target = xdelta3.dec_tgtlen;
+    stats.delta = length;
+
+    var modes = xdelta3.dec_modes;
+    var s_near = stats.modes.near.length;
+    stats.modes.self = modes[VCD_SELF];
+    stats.modes.here = modes[VCD_HERE];
+    for (i = 0; i < s_near; i++) {
+      stats.modes.near[i] = modes[2 + i];
+    }
+    for (i = 0; i < stats.modes.same.length; i++) {
+      stats.modes.same[i] = modes[2 + s_near + i];
+    }
+    modes.fill(0);
+
+    var sects = [xdelta3.data_sect, xdelta3.inst_sect, xdelta3.addr_sect];
+    var names = ['data', 'inst', 'addr'];
+    for (i = 0; i < 3; i++) {
+      stats.sections[names[i]].size = sects[i].size;
+      stats.sections[names[i]].stored = sects[i].stored;
+    }
+  }
+
+  /**
+   * Adds the statistics of a window to the total.
+   * @param {!xd3_delta_stats} total
+   * @param {!xd3_delta_stats} stats
+   */
+  function xd3_add_stats(total, stats) {
+    var add = function(to, from) {
+      while (to.length < from.length) {
+        to.push(0);
+      }
+      for (var i = 0; i < from.length; i++) {
+        to[i] += from[i];
+      }
+    };
+    total.target += stats.target;
+    total.delta += stats.delta;
+    var counts = ['run', 'add', 'sourceCopy', 'targetCopy'];
+    for (var i = 0; i < counts.length; i++) {
+      total[counts[i]].count += stats[counts[i]].count;
+      total[counts[i]].bytes += stats[counts[i]].bytes;
+    }
+    add(total.sourceDistance, stats.sourceDistance);
+    add(total.targetDistance, stats.targetDistance);
+    total.modes.self += stats.modes.self;
+    total.modes.here += stats.modes.here;
+    add(total.modes.near, stats.modes.near);
+    add(total.modes.same, stats.modes.same);
+    var sects = ['data', 'inst', 'addr'];
+    for (i = 0; i < sects.length; i++) {
+      total.sections[sects[i]].size += stats.sections[sects[i]].size;
+      total.sections[sects[i]].stored += stats.sections[sects[i]].stored;
+    }
+  }
+
+  /**
+   * A target described by where its bytes come from, for compose. Each
+   * piece is XD3_RUN of the byte addr, XD3_ADD of data from addr,
+   * XD3_SRCCPY from addr in the source or XD3_TGTCPY from addr earlier in
+   * this target. An XD3_TGTCPY may overlap itself, so a long copy with a
+   * short period is one piece. Pieces that continue the last one are merged
+   * into it.
+   * @constructor
+   * @struct
+   */
+  function xd3_piecemap() {
+    /** @type {number} */
+    this.count = 0;
+
+    /**
+     * Where each piece starts in the target.
+     * @type {!Array<number>}
+     */
+    this.start = [];
+
+    /** @type {!Array<number>} */
+    this.size = [];
+
+    /** @type {!Array<number>} */
+    this.type = [];
+
+    /** @type {!Array<number>} */
+    this.addr = [];
+
+    /**
+     * The data section of an XD3_ADD.
+     * @type {!Array<?Uint8Array>}
+     */
+    this.data = [];
+
+    /**
+     * The length of the target.
+     * @type {number}
+     */
+    this.end = 0;
+  }
+
+  /**
+   * Appends a piece.
+   * @param {number} type
+   * @param {number} size
+   * @param {number} addr
+   * @param {?Uint8Array} data
+   */
+  xd3_piecemap.prototype.xd3_piecemap_push = function(type, size, addr,
+      data) {
+    if (size == 0) {
+      return;
+    }
+    var p = this.count - 1;
+    if (p >= 0 && this.type[p] == type &&
+        (type == XD3_RUN ? this.addr[p] == addr :
+         this.data[p] === data && this.addr[p] + this.size[p] == addr)) {
+      this.size[p] += size;
+      this.end += size;
+      return;
+    }
+    this.start.push(this.end);
+    this.size.push(size);
+    this.type.push(type);
+    this.addr.push(addr);
+    this.data.push(data);
+    this.count++;
+    this.end += size;
+  };
+
+  /**
+   * @param {number} pos Less than this.end.
+   * @return {number} The piece that pos is in.
+   */
+  xd3_piecemap.prototype.xd3_piecemap_find = function(pos) {
+    var lo = 0;
+    var hi = this.count - 1;
+    while (lo < hi) {
+      var mid = (lo + hi + 1) >> 1;
+      if (this.start[mid] <= pos) {
+        lo = mid;
+      } else {
+        hi = mid - 1;
+      }
+    }
+    return lo;
+  };
+
+  /**
+   * Calls fn(type, size, addr, data) with the pieces of a range of the
+   * target, the first and last cut to the range. fn may append to this map.
+   *
+   * An XD3_TGTCPY is resolved to its first period, then passed to fn with
+   * addr the period, the distance back to the bytes fn was just given.
+   * @param {number} from
+   * @param {number} size from + size is at most this.end.
+   * @param {function(number, number, number, ?Uint8Array)} fn
+   */
+  xd3_piecemap.prototype.xd3_piecemap_each = function(from, size, fn) {
+    var limit = from + size;
+    var i = this.xd3_piecemap_find(from);
+    while (from < limit) {
+      var start = this.start[i];
+      var type = this.type[i];
+      var take = Math.min(start + this.size[i], limit) - from;
+      if (type == XD3_TGTCPY) {
+        var period = start - this.addr[i];
+        var phase = (from - start) % period;
+        var first = Math.min(take, period - phase);
+        this.xd3_piecemap_each(this.addr[i] + phase, first, fn);
+        this.xd3_piecemap_each(this.addr[i], Math.min(take, period) - first,
+            fn);
+        if (take > period) {
+          fn(XD3_TGTCPY, take - period, period, null);
+        }
+      } else {
+        fn(type, take, (type == XD3_RUN) ? this.addr[i] :
+            this.addr[i] + from - start, this.data[i]);
+      }
+      from += take;
+      i++;
+    }
+  };
+
+  /**
+   * Appends pieces passed by xd3_piecemap_each of a map, this one or
+   * another.
+   * @param {number} type
+   * @param {number} size
+   * @param {number} addr
+   * @param {?Uint8Array} data
+   */
+  xd3_piecemap.prototype.xd3_piecemap_piece = function(type, size, addr,
+      data) {
+    this.xd3_piecemap_push(type, size,
+        (type == XD3_TGTCPY) ? this.end - addr : addr, data);
+  };
+
+  /**
+   * Appends a copy from earlier in this target, which may overlap the bytes
+   * it appends. A copy of the byte just before is a run. Otherwise the
+   * first period is resolved to pieces and the rest is an XD3_TGTCPY, so
+   * that a copy with a short period of source bytes is not a source copy
+   * per period.
+   * @param {number} from
+   * @param {number} size
+   */
+  xd3_piecemap.prototype.xd3_piecemap_copy = function(from, size) {
+    var self = this;
+    var piece = function(type, size, addr, data) {
+      self.xd3_piecemap_piece(type, size, addr, data);
+    };
+    var period = this.end - from;
+    if (period == 1) {
+      var i = this.xd3_piecemap_find(from);
+      if (this.type[i] == XD3_RUN) {
+        this.xd3_piecemap_push(XD3_RUN, size, this.addr[i], null);
+        return;
+      }
+      if (this.type[i] == XD3_ADD) {
+        this.xd3_piecemap_push(XD3_RUN, size,
+            this.data[i][this.addr[i] + from - this.start[i]], null);
+        return;
+      }
+    }
+    this.xd3_piecemap_each(from, Math.min(size, period), piece);
+    if (size > period) {
+      this.xd3_piecemap_push(XD3_TGTCPY, size - period, from + period, null);
+    }
+  };
+
+  /**
+   * Resolves the instructions of the current window of a walked delta into
+   * pieces. Copies from the source are looked up in srcmap, or kept as
+   * copies from the source without it. Copies from the target are looked
+   * up in tgtmap, which the window's pieces are appended to. If win is
+   * given the pieces are appended to it too, except that copies within the
+   * window stay copies.
+   * @param {!_XDelta3Decoder} xdelta3
+   * @param {?xd3_piecemap} srcmap
+   * @param {?xd3_piecemap} tgtmap Only null if the delta has no VCD_TARGET
+   *     windows and win is given.
+   * @param {?xd3_piecemap} win
+   */
+  function xd3_compose_window(xdelta3, srcmap, tgtmap, win) {
+    var ops = xdelta3.dec_ops;
+    var data = xdelta3.data_sect.bytes;
+    var winstart = xdelta3.dec_winstart;
+    var piece = function(type, size, addr, data) {
+      if (win) {
+        win.xd3_piecemap_piece(type, size, addr, data);
+      }
+      if (tgtmap) {
+        tgtmap.xd3_piecemap_piece(type, size, addr, data);
+      }
+    };
+    for (var i = 0; i < ops.count; i++) {
+      var size = ops.size[i];
+      var addr = ops.addr[i];
+      switch (ops.type[i]) {
+        case XD3_RUN:
+          piece(XD3_RUN, size, data[addr], null);
+          break;
+
+        case XD3_ADD:
+          piece(XD3_ADD, size, addr, data);
+          break;
+
+        case XD3_SRCCPY:
+          if (srcmap) {
+            srcmap.xd3_piecemap_each(addr, size, piece);
+          } else {
+            piece(XD3_SRCCPY, size, addr, null);
+          }
+          break;
+
+        case XD3_OLDCPY:
+          tgtmap.xd3_piecemap_each(addr, size, piece);
+          break;
+
+        default:
+          if (win) {
+            win.xd3_piecemap_push(XD3_TGTCPY, size, addr, null);
+          }
+          if (tgtmap) {
+            tgtmap.xd3_piecemap_copy(winstart + addr, size);
+          }
+      }
+    }
+  }
+
+  /**
+   * @param {number} val
+   * @return {number} The length of val as a VCDIFF integer.
+   */
+  function xd3_integer_length(val) {
+    var length = 1;
+    while (val >= 128) {
+      val = Math.floor(val / 128);
+      length++;
+    }
+    return length;
+  }
+
+  /**
+   * Appends a window made of the pieces of win with the default code table.
+   * Its copy window is the part of the source that it copies from. Each
+   * copy address is VCD_SELF or VCD_HERE, whichever is shorter.
+   * @param {!Array<number>} bytes
+   * @param {!xd3_piecemap} win
+   * @param {?number} cksum The Adler32 checksum of the window, if known.
+   */
+  function xd3_emit_window(bytes, win, cksum) {
+    var cpyoff = Infinity;
+    var cpyend = 0;
+    for (var i = 0; i < win.count; i++) {
+      if (win.type[i] == XD3_SRCCPY) {
+        cpyoff = Math.min(cpyoff, win.addr[i]);
+        cpyend = Math.max(cpyend, win.addr[i] + win.size[i]);
+      }
+    }
+    var cpylen = (cpyoff == Infinity) ? 0 : cpyend - cpyoff;
+
+    var data = [];
+    var inst = [];
+    var addrs = [];
+    for (var i = 0; i < win.count; i++) {
+      var type = win.type[i];
+      var size = win.size[i];
+      if (type == XD3_RUN) {
+        inst.push(0);
+        xd3_emit_integer(inst, size);
+        data.push(win.addr[i]);
+      } else if (type == XD3_ADD) {
+        /* ADDs from different data sections are one ADD here. */
+        for (size = 0; i < win.count && win.type[i] == XD3_ADD; i++) {
+          for (var j = 0; j < win.size[i]; j++) {
+            data.push(win.data[i][win.addr[i] + j]);
+          }
+          size += win.size[i];
+        }
+        i--;
+        if (size <= 17) {
+          inst.push(1 + size);
+        } else {
+          inst.push(1);
+          xd3_emit_integer(inst, size);
+        }
+      } else {
+        var addr = (type == XD3_SRCCPY) ? win.addr[i] - cpyoff :
+            cpylen + win.addr[i];
+        var here = cpylen + win.start[i];
+        var mode = (xd3_integer_length(here - addr) <
+                    xd3_integer_length(addr)) ? VCD_HERE : VCD_SELF;
+        if (size >= 4 && size <= 18) {
+          inst.push(19 + 16 * mode + size - 3);
+        } else {
+          inst.push(19 + 16 * mode);
+          xd3_emit_integer(inst, size);
+        }
+        xd3_emit_integer(addrs, (mode == VCD_HERE) ? here - addr : addr);
+      }
+    }
+
+    var body = [];
+    xd3_emit_integer(body, win.end);  // DEC_TGTLEN
+    body.push(0);  // DEC_DELIND
+    xd3_emit_integer(body, data.length);
+    xd3_emit_integer(body, inst.length);
+    xd3_emit_integer(body, addrs.length);
+    if (cksum !== null) {
+      body.push((cksum >>> 24) & 0xff, (cksum >>> 16) & 0xff,
+                (cksum >>> 8) & 0xff, cksum & 0xff);
+    }
+    bytes.push((cpylen ? VCD_SOURCE : 0) | (cksum !== null ? VCD_ADLER32 : 0));
+    if (cpylen) {
+      xd3_emit_integer(bytes, cpylen);
+      xd3_emit_integer(bytes, cpyoff);
+    }
+    xd3_emit_integer(bytes, body.length + data.length + inst.length +
+        addrs.length);  // DEC_ENCLEN
+    xd3_append(bytes, body);
+    xd3_append(bytes, data);
+    xd3_append(bytes, inst);
+    xd3_append(bytes, addrs);
+  }
+
+  /**
+   * @param {!Array<number>} bytes
+   * @param {!Array<number>} more
+   */
+  function xd3_append(bytes, more) {
+    for (var i = 0; i < more.length; i++) {
+      bytes.push(more[i]);
+    }
+  }
+
+  /**
+   * The code-table double instruction.
+   * @constructor
+   */
+  function xd3_dinst() {
+    /** @type {number} */
+    this.type1 = XD3_NOOP;
+    /** @type {number} */
+    this.size1 = 0;
+    /** @type {number} */
+    this.type2 = XD3_NOOP;
+    /** @type {number} */
+    this.size2 = 0;
+  }
+
+  /**
+   * @param {!xd3_code_table_desc} desc
+   * @return {!xd3_dinst_table}
+   */
   function xd3_build_code_table(desc) {
     var row = 0;
     var tableRows = new Array(256);
     for (var i = 0; i < 256; i++) {
-      tableRows[i] = new xd3_dinst();
+      tableRows[i] = new xd3_dinst();
+    }
+    var cpyModes = 2 + desc.near_modes + desc.same_modes;
+
+    // The single RUN command.
+    tableRows[row++].type1 = XD3_RUN;
+
+    // The ADD only commands.
+    tableRows[row++].type1 = XD3_ADD;
+    for (var size1 = 1; size1 <= desc.add_sizes; size1++) {
+      tableRows[row].type1 = XD3_ADD;
+      tableRows[row++].size1 = size1;
+    }
+
+    // The Copy only commands.
+    for (var mode = 0; mode < cpyModes; mode++) {
+      tableRows[row++].type1 = XD3_CPY + mode;
+
+      for (var size1 = MIN_MATCH; size1 < MIN_MATCH + desc.cpy_sizes; size1++) {
+        tableRows[row].type1 = XD3_CPY + mode;
+        tableRows[row++].size1 = size1;
+      }
+    }
+
+    // The Add/Copy commands.
+    for (var mode = 0; mode < cpyModes; mode++) {
+      for (var size1 = 1; size1 <= desc.addcopy_add_max; size1++) {
+        var max = (mode < 2 + desc.near_modes) ?  //
+            desc.addcopy_near_cpy_max :
+            desc.addcopy_same_cpy_max;
+        for (var size2 = MIN_MATCH; size2 <= max; size2++) {
+          tableRows[row].type1 = XD3_ADD;
+          tableRows[row].size1 = size1;
+          tableRows[row].type2 = XD3_CPY + mode;
+          tableRows[row++].size2 = size2;
+        }
+      }
+    }
+
+    // The Copy/Add commands.
+    for (var mode = 0; mode < cpyModes; mode++) {
+      var max = (mode < 2 + desc.near_modes) ?  //
+          desc.copyadd_near_cpy_max :
+          desc.copyadd_same_cpy_max;
+      for (var size1 = MIN_MATCH; size1 <= max; size1++) {
+        for (var size2 = 1; size2 <= desc.copyadd_add_max; size2++) {
+          tableRows[row].type1 = XD3_CPY + mode;
+          tableRows[row].size1 = size1;
+          tableRows[row].type2 = XD3_ADD;
+          tableRows[row++].size2 = size2;
+        }
+      }
+    }
+
+    return new xd3_dinst_table(tableRows);
+  }
+
+
+  /**
+   * @constructor
+   */
+  function xd3_code_table_desc() {
+    this.add_sizes = 0;
+    this.near_modes = 0;
+    this.same_modes = 0;
+    this.cpy_sizes = 0;
+
+    this.addcopy_add_max = 0;
+    this.addcopy_near_cpy_max = 0;
+    this.addcopy_same_cpy_max = 0;
+
+    this.copyadd_add_max = 0;
+    this.copyadd_near_cpy_max = 0;
+    this.copyadd_same_cpy_max = 0;
+  }
+
+
+  /**
+   * This builds the __rfc3284_code_table_desc
+   * Assumes a single RUN instruction
+   * Assumes that MIN_MATCH is 4.
+   * @return {!xd3_code_table_desc}
+   */
+  function build_rfc3284_code_table_desc() {
+    var desc = new xd3_code_table_desc();
+    desc.add_sizes = 17;
+    desc.near_modes = 4;
+    desc.same_modes = 3;
+    desc.cpy_sizes = 15;
+
+    desc.addcopy_add_max = 4;
+    desc.addcopy_near_cpy_max = 6;
+    desc.addcopy_same_cpy_max = 4;
+
+    desc.copyadd_add_max = 1;
+    desc.copyadd_near_cpy_max = 4;
+    desc.copyadd_same_cpy_max = 4;
+
+    // xd3_code_table_sizes addcopy_max_sizes[MAX_MODES];
+    // { {6,163,3},{6,175,3},{6,187,3},{6,199,3},{6,211,3},{6,223,3},
+    // {4,235,1},{4,239,1},{4,243,1} },
+
+    // xd3_code_table_sizes copyadd_max_sizes[MAX_MODES];
+    // { {4,247,1},{4,248,1},{4,249,1},{4,250,1},{4,251,1},{4,252,1},
+    // {4,253,1},{4,254,1},{4,255,1} },
+
+    return desc;
+  }
+
+  var __rfc3284_code_table_desc = build_rfc3284_code_table_desc();
+
+  var A32_BASE = 65521; /* Largest prime smaller than 2^16 */
+  var A32_NMAX = 5552;  /* NMAX is the largest n such that 255n(n+1)/2
+                            + (n+1)(BASE-1) <= 2^32-1 */
+
+  /**
+   * Calculated the Adler32 checksum.
+   * The inner loop is unrolled 16 times like A32_DO16 in the C code.
+   * @param {number} adler The checksum so far, 1 to start.
+   * @param {!Uint8Array} buf
+   * @param {number} pos
+   * @param {number} len
+   * @return {number}
+   */
+  function adler32(adler, buf, pos, len) {
+    var s1 = adler & 0xffff;
+    var s2 = (adler >> 16) & 0xffff;
+    var k;
+
+    while (len > 0) {
+      k = (len < A32_NMAX) ? len : A32_NMAX;
+      len -= k;
+
+      while (k >= 16) {
+        s1 += buf[pos]; s2 += s1;
+        s1 += buf[pos + 1]; s2 += s1;
+        s1 += buf[pos + 2]; s2 += s1;
+        s1 += buf[pos + 3]; s2 += s1;
+        s1 += buf[pos + 4]; s2 += s1;
+        s1 += buf[pos + 5]; s2 += s1;
+        s1 += buf[pos + 6]; s2 += s1;
+        s1 += buf[pos + 7]; s2 += s1;
+        s1 += buf[pos + 8]; s2 += s1;
+        s1 += buf[pos + 9]; s2 += s1;
+        s1 += buf[pos + 10]; s2 += s1;
+        s1 += buf[pos + 11]; s2 += s1;
+        s1 += buf[pos + 12]; s2 += s1;
+        s1 += buf[pos + 13]; s2 += s1;
+        s1 += buf[pos + 14]; s2 += s1;
+        s1 += buf[pos + 15]; s2 += s1;
+        pos += 16;
+        k -= 16;
+      }
+
+      while (k != 0) {
+        s1 += buf[pos++];
+        s2 += s1;
+        k--;
+      }
+
+      s1 %= A32_BASE;
+      s2 %= A32_BASE;
+    }
+
+    return (s2 << 16) | s1;
+  }
+
+
+  /**
+   * @constructor
+   */
+  function xd3_addr_cache(s_near, s_same) {
+    this.s_near = s_near;
+    this.s_same = s_same;
+    this.next_slot = 0; /* the circular index for near */
+    this.near_array = null;    /* array of size s_near        */
+    this.same_array = null;    /* array of size s_same*256    */
+  }
+
+
+  /**
+   * @param {!xd3_addr_cache} acache
+   */
+  function xd3_init_cache(acache) {
+    if (acache.s_near > 0) {
+      for (var i = 0; i < acache.near_array.length; i++) {
+        acache.near_array[i] = 0;
+      }
+      acache.next_slot = 0;
+    }
+
+    if (acache.s_same > 0) {
+      for (var i = 0; i < acache.same_array.length; i++) {
+        acache.same_array[i] = 0;
+      }
+    }
+  }
+
+  /**
+   * Used by the decoder to buffer input in sections.
+   * XDelta3 C++ struct.
+   * @constructor
+   * @struct
+   */
+  function xd3_desect() {
+    /**
+     * The buffer as a slice of the backingBuffer;
+     * @type {?Uint8Array}
+     */
+    this.bytes = null;
+
+    /** @type {number} */
+    this.size = 0;
+
+    /**
+     * The size in the delta, before secondary decompression.
+     * @type {number}
+     */
+    this.stored = 0;
+
+    /** @type {number} */
+    this.pos = 0;
+  }
+
+  /**
+   * Gets a byte from the section.
+   * @return {number}
+   */
+  xd3_desect.prototype.getByte = function() {
+    if (!this.bytes) {
+      throw new Error('bytes not set');
+    }
+    if (this.pos >= this.size) {
+      throw new Error('section underflow');
+    }
+    return this.bytes[this.pos++];
+  };
+
+  /**
+   * Gets an integer from the section.
+   * XDelta3 integers are encodes as a variable number of 7 bit bytes. Bit 8, the
+   * most significant bit is used to indicate more bytes needed.
+   * @return {number}
+   */
+  xd3_desect.prototype.getInteger = function() {
+    if (!this.bytes) {
+      throw new Error('bytes not set');
+    }
+    var val = 0;
+    for (var i = 0; i < 10; i++) {
+      if (this.pos >= this.size) {
+        throw new Error('end-of-input in read_integer');
+      }
+      var aByte = this.bytes[this.pos++];
+      val += aByte & 0x7F;
+      if (!(aByte & 0x80)) {
+        return val;
+      }
+      // Multiply rather than shift, copy sizes and addresses can exceed 31
+      // bits.
+      val *= 128;
+    }
+    throw new Error('invalid number');
+  };
+
+
+  /**
+   * Builds a default code table.
+   * @return {!xd3_dinst_table}
+   */
+  function xd3_rfc3284_code_table() {
+    if (!__rfc3284_code_table) {
+      __rfc3284_code_table = xd3_build_code_table(__rfc3284_code_table_desc);
+    }
+    return __rfc3284_code_table;
+  }
+
+  /**
+   * The default code table, built on first use. Its rows are never changed.
+   * @type {?xd3_dinst_table}
+   */
+  var __rfc3284_code_table = null;
+
+  /**
+   * The size of a code table string: the type1, type2, size1, size2, mode1
+   * and mode2 columns of the 256 rows.
+   * @type {number}
+   */
+  var CODE_TABLE_STRING_SIZE = 6 * 256;
+
+  /**
+   * Computes the string of a code table, which an application code table is
+   * delta encoded against (RFC 3284 section 7).
+   * @param {!xd3_dinst_table} code_table
+   * @return {!Uint8Array}
+   */
+  function xd3_compute_code_table_string(code_table) {
+    var str = new Uint8Array(CODE_TABLE_STRING_SIZE);
+    for (var i = 0; i < 256; i++) {
+      var row = code_table.tableRows[i];
+      str[i] = Math.min(row.type1, XD3_CPY);
+      str[256 + i] = Math.min(row.type2, XD3_CPY);
+      str[512 + i] = row.size1;
+      str[768 + i] = row.size2;
+      str[1024 + i] = (row.type1 >= XD3_CPY) ? row.type1 - XD3_CPY : 0;
+      str[1280 + i] = (row.type2 >= XD3_CPY) ? row.type2 - XD3_CPY : 0;
+    }
+    return str;
+  }
+
+  /**
+   * Decodes the code table of a VCD_CODETABLE header, which is a delta
+   * against the string of the default table.
+   * @param {!Uint8Array} data The code table data after the near and same
+   *     bytes.
+   * @param {number} modes The number of address modes, 2 + near + same.
+   * @return {!xd3_dinst_table}
+   */
+  function xd3_apply_table_encoding(data, modes) {
+    var dflt_string = xd3_compute_code_table_string(xd3_rfc3284_code_table());
+    var code_string = new Uint8Array(
+        new _XDelta3Decoder(data, dflt_string).xd3_decode_input());
+    if (code_string.length != CODE_TABLE_STRING_SIZE) {
+      throw new Error('invalid code table size');
+    }
+
+    var tableRows = new Array(256);
+    for (var i = 0; i < 256; i++) {
+      var row = new xd3_dinst();
+      row.type1 = xd3_code_table_type(code_string[i], code_string[1024 + i],
+          modes);
+      row.type2 = xd3_code_table_type(code_string[256 + i],
+          code_string[1280 + i], modes);
+      row.size1 = code_string[512 + i];
+      row.size2 = code_string[768 + i];
+      tableRows[i] = row;
+    }
+    return new xd3_dinst_table(tableRows);
+  }
+
+  /**
+   * @param {number} type XD3_NOOP, XD3_ADD, XD3_RUN or XD3_CPY.
+   * @param {number} mode The address mode of an XD3_CPY.
+   * @param {number} modes
+   * @return {number} The xd3_dinst type, XD3_CPY + mode for a copy.
+   */
+  function xd3_code_table_type(type, mode, modes) {
+    if (type > XD3_CPY) {
+      throw new Error('invalid code table type');
+    }
+    if (mode >= modes || (mode != 0 && type != XD3_CPY)) {
+      throw new Error('invalid code table mode');
+    }
+    return type + mode;
+  }
+
+  /**
+   * Allocates and initializes a Javascript Array.
+   * @return {!Array<number>}
+   */
+  function allocArray(len, val) {
+    var arr = new Array(len);
+    for (var i = 0; i < len; i++) {
+      arr[i] = val;
+    }
+    return arr;
+  }
+
+  /**
+   * @param {Uint8Array|XDelta3Decoder.Source} source
+   * @constructor
+   */
+  function xd3_source(source) {
+    /**
+     * The source the decoder was given, see xd3_stream_reset.
+     * @type {Uint8Array|XDelta3Decoder.Source}
+     */
+    this.source = source;
+
+    /** @type {number} */
+    this.cpyoff_blkoff = -1;
+
+    /** @type {number} */
+    this.size = 0;
+
+    /** @type {number} */
+    this.blksize = 1;
+
+    /** @type {number} */
+    this.curblkno = -1;
+
+    /** @type {?Uint8Array} */
+    this.curblk = null;
+
+    /** @type {?function(number): !Uint8Array} */
+    this.getblk = null;
+
+    /** @type {?function(number): !Promise<!Uint8Array>} */
+    this.getblkAsync = null;
+
+    /**
+     * The cached blocks by block number, least recently used first.
+     * @type {!Map<number, !Uint8Array>}
+     */
+    this.blkcache = new Map();
+
+    /** @type {number} */
+    this.max_blocks = 1;
+
+    /**
+     * Where the hit and miss counts go.
+     * @type {{hits: (number|undefined), misses: (number|undefined)}}
+     */
+    this.stats = {hits: 0, misses: 0};
+
+    if (source instanceof Uint8Array) {
+      /* Like xd3_process_memory, an in-memory source is one block that is
+       * always current. */
+      this.size = source.length;
+      this.blksize = Math.max(source.length, 1);
+      this.curblkno = 0;
+      this.curblk = source;
+    } else if (source) {
+      this.size = source.size;
+      this.blksize = source.blksize;
+      this.getblk = source.getblk ? source.getblk.bind(source) : null;
+      this.getblkAsync =
+          source.getblkAsync ? source.getblkAsync.bind(source) : null;
+      this.max_blocks = Math.max(source.max_blocks || XD3_DEFAULT_SRCBLOCKS, 1);
+      this.stats = source;
+      this.stats.hits = this.stats.hits || 0;
+      this.stats.misses = this.stats.misses || 0;
+    }
+  }
+
+  /**
+   * Makes a block current. It comes from the cache when it is there,
+   * otherwise from the getblk callback, evicting the least recently used
+   * block if the cache is full.
+   * @param {number} blkno
+   * @return {!Uint8Array}
+   */
+  xd3_source.prototype.xd3_getblk = function(blkno) {
+    if (blkno == this.curblkno) {
+      this.stats.hits++;
+      return this.curblk;
+    }
+
+    var blk = this.blkcache.get(blkno);
+    if (blk) {
+      this.stats.hits++;
+      this.blkcache.delete(blkno);  // Move it to the back.
+    } else {
+      if (!this.getblk) {
+        throw new Error('source block ' + blkno + ' was not read');
+      }
+      blk = this.getblk(blkno);
+      this.xd3_putblk(blkno, blk);
+      this.xd3_trim_cache();
+    }
+    this.blkcache.set(blkno, blk);
+    this.curblk = blk;
+    this.curblkno = blkno;
+    return blk;
+  };
+
+  /**
+   * Checks and caches a block from getblk or getblkAsync.
+   * @param {number} blkno
+   * @param {!Uint8Array} blk
+   */
+  xd3_source.prototype.xd3_putblk = function(blkno, blk) {
+    var onblk = Math.min(this.blksize, this.size - blkno * this.blksize);
+    if (!blk || blk.length < onblk) {
+      throw new Error('getblk returned a short block');
+    }
+    this.stats.misses++;
+    this.blkcache.set(blkno, blk);
+  };
+
+  /**
+   * Evicts the blocks from first to last, whose bytes are gone.
+   * @param {number} first
+   * @param {number} last
+   */
+  xd3_source.prototype.xd3_drop_blocks = function(first, last) {
+    for (var blkno = first; blkno <= last; blkno++) {
+      this.blkcache.delete(blkno);
+    }
+    if (this.curblkno >= first && this.curblkno <= last) {
+      this.curblkno = -1;
+      this.curblk = null;
+    }
+  };
+
+  /**
+   * Evicts the least recently used blocks down to max_blocks. The blocks a
+   * window prefetches are all kept until the window is done.
+   */
+  xd3_source.prototype.xd3_trim_cache = function() {
+    var keys = this.blkcache.keys();
+    while (this.blkcache.size > this.max_blocks) {
+      this.blkcache.delete(keys.next().value);
     }
-    var cpyModes = 2 + desc.near_modes + desc.same_modes;
+  };
 
-    // The single RUN command.
-    tableRows[row++].type1 = XD3_RUN;
+  /**
+   * The DJW static Huffman secondary compressor, as in the C xdelta3-djw.h.
+   *
+   * A section is coded with 1 to DJW_MAX_GROUPS Huffman codes of the byte
+   * alphabet. With more than one, the output is split into sectors and a
+   * selector per sector names its code. The code lengths of all the codes
+   * are move-to-front coded, with two run symbols for repeats of the front
+   * value, and prefix coded with a code length code sent first. The
+   * selectors are coded the same way with a code of their own. Bits are
+   * read from the low bit of each byte up, and each code most significant
+   * bit first.
+   *
+   * The C decoder reads a symbol a bit at a time. Here each code has a
+   * table indexed by its next DJW_TABLE_BITS bits, reversed, and only the
+   * longer codes continue a bit at a time from the canonical code limits.
+   * Each section carries its own codes, so the sections are independent.
+   */
 
-    // The ADD only commands.
-    tableRows[row++].type1 = XD3_ADD;
-    for (var size1 = 1; size1 <= desc.add_sizes; size1++) {
-      tableRows[row].type1 = XD3_ADD;
-      tableRows[row++].size1 = size1;
+  /** @type {number} */
+  var DJW_ALPHABET_SIZE = 256;
+  /**
+   * The longest code of a byte.
+   * @type {number}
+   */
+  var DJW_MAX_CODELEN = 20;
+  /**
+   * The code length alphabet: RUN_0, RUN_1 and the move-to-front positions
+   * 1 to DJW_MAX_CODELEN.
+   * @type {number}
+   */
+  var DJW_TOTAL_CODES = DJW_MAX_CODELEN + 2;
+  /** @type {number} */
+  var DJW_RUN_CODES = 2;
+  /**
+   * The code length code always sends this many lengths, and up to
+   * 2^DJW_EXTRA_CODE_BITS - 1 more.
+   * @type {number}
+   */
+  var DJW_EXTRA_12OFFSET = 7;
+  /** @type {number} */
+  var DJW_EXTRA_CODE_BITS = 4;
+  /** @type {number} */
+  var DJW_MAX_GROUPS = 8;
+  /** @type {number} */
+  var DJW_GROUP_BITS = 3;
+  /** @type {number} */
+  var DJW_SECTORSZ_MULT = 5;
+  /** @type {number} */
+  var DJW_SECTORSZ_BITS = 5;
+  /** @type {number} */
+  var DJW_MAX_CLCLEN = 15;
+  /** @type {number} */
+  var DJW_CLCLEN_BITS = 4;
+  /** @type {number} */
+  var DJW_MAX_GBCLEN = 7;
+  /** @type {number} */
+  var DJW_GBCLEN_BITS = 3;
+  /**
+   * The bits of a code's lookup table, at most 5 bits short of the bit
+   * buffer filled before each symbol.
+   * @type {number}
+   */
+  var DJW_TABLE_BITS = 10;
+
+  /**
+   * The initial move-to-front order of the code lengths, the likely lengths
+   * first.
+   */
+  var djw_encode_12basic = [4, 5, 6, 7, 8];
+  var djw_encode_12extra = [
+    9, 10, 3, 11, 2, 12, 13, 1, 14, 15, 16, 17, 18, 19, 20];
+
+  /**
+   * @param {!Uint8Array} mtf The DJW_MAX_CODELEN + 1 code lengths.
+   */
+  function djw_init_clen_mtf_1_2(mtf) {
+    var n = 0;
+    mtf[n++] = 0;
+    for (var i = 0; i < djw_encode_12basic.length; i++) {
+      mtf[n++] = djw_encode_12basic[i];
     }
+    for (var i = 0; i < djw_encode_12extra.length; i++) {
+      mtf[n++] = djw_encode_12extra[i];
+    }
+  }
 
-    // The Copy only commands.
-    for (var mode = 0; mode < cpyModes; mode++) {
-      tableRows[row++].type1 = XD3_CPY + mode;
+  /**
+   * A canonical prefix code, like the C inorder, base and limit tables of
+   * djw_build_decoder, with a lookup table of the short codes.
+   * @param {number} asize The size of the alphabet.
+   * @constructor
+   * @struct
+   */
+  function xd3_djw_code(asize) {
+    /**
+     * The symbols in code order.
+     * @type {!Uint16Array}
+     */
+    this.inorder = new Uint16Array(asize);
+    /** @type {!Int32Array} */
+    this.base = new Int32Array(DJW_MAX_CODELEN + 2);
+    /**
+     * The last code of each length, -1 below the shortest.
+     * @type {!Int32Array}
+     */
+    this.limit = new Int32Array(DJW_MAX_CODELEN + 2);
+    /** @type {number} */
+    this.min_len = 0;
+    /** @type {number} */
+    this.max_len = 0;
+    /**
+     * The symbol << 5 | length of the code starting with the index bits,
+     * the first bit lowest, or 0 for a longer code.
+     * @type {!Int32Array}
+     */
+    this.table = new Int32Array(1 << DJW_TABLE_BITS);
+    /** @type {number} */
+    this.mask = 0;
+  }
 
-      for (var size1 = MIN_MATCH; size1 < MIN_MATCH + desc.cpy_sizes; size1++) {
-        tableRows[row].type1 = XD3_CPY + mode;
-        tableRows[row++].size1 = size1;
+  /**
+   * Builds the code from the code lengths, 0 for an unused symbol.
+   * @param {!Uint8Array} clen
+   * @param {number} asize
+   * @param {number} abs_max The longest length clen may hold.
+   */
+  xd3_djw_code.prototype.build = function(clen, asize, abs_max) {
+    var nr_clen = new Int32Array(abs_max + 1);
+    for (var i = 0; i < asize; i++) {
+      nr_clen[clen[i]]++;
+    }
+    var min_len = 1;
+    while (min_len <= abs_max && nr_clen[min_len] == 0) {
+      min_len++;
+    }
+    var max_len = abs_max;
+    while (max_len > 0 && nr_clen[max_len] == 0) {
+      max_len--;
+    }
+    if (max_len == 0) {
+      throw new Error('secondary decoder invalid code');
+    }
+    // An incomplete code is valid, its unused codes are detected while
+    // decoding. An oversubscribed code is not.
+    var left = 1;
+    for (var len = 1; len <= max_len; len++) {
+      left = (left << 1) - nr_clen[len];
+      if (left < 0) {
+        throw new Error('secondary decoder invalid code');
       }
     }
 
-    // The Add/Copy commands.
-    for (var mode = 0; mode < cpyModes; mode++) {
-      for (var size1 = 1; size1 <= desc.addcopy_add_max; size1++) {
-        var max = (mode < 2 + desc.near_modes) ?  //
-            desc.addcopy_near_cpy_max :
-            desc.addcopy_same_cpy_max;
-        for (var size2 = MIN_MATCH; size2 <= max; size2++) {
-          tableRows[row].type1 = XD3_ADD;
-          tableRows[row].size1 = size1;
-          tableRows[row].type2 = XD3_CPY + mode;
-          tableRows[row++].size2 = size2;
+    var base = this.base;
+    var limit = this.limit;
+    var tmp_base = new Int32Array(max_len + 1);
+    limit.fill(-1);
+    base[min_len] = 0;
+    limit[min_len] = nr_clen[min_len] - 1;
+    for (var len = min_len + 1; len <= max_len; len++) {
+      var last_limit = (limit[len - 1] + 1) << 1;
+      tmp_base[len] = tmp_base[len - 1] + nr_clen[len - 1];
+      limit[len] = last_limit + nr_clen[len] - 1;
+      base[len] = last_limit - tmp_base[len];
+    }
+    for (var i = 0; i < asize; i++) {
+      if (clen[i] != 0) {
+        this.inorder[tmp_base[clen[i]]++] = i;
+      }
+    }
+    this.min_len = min_len;
+    this.max_len = max_len;
+
+    var tbits = Math.min(max_len, DJW_TABLE_BITS);
+    var table = this.table;
+    table.fill(0, 0, 1 << tbits);
+    this.mask = (1 << tbits) - 1;
+    var n = 0;
+    for (var len = min_len; len <= tbits; len++) {
+      for (var code = limit[len] - nr_clen[len] + 1; code <= limit[len];
+           code++) {
+        var rev = 0;
+        for (var b = 0; b < len; b++) {
+          rev |= ((code >> b) & 1) << (len - 1 - b);
+        }
+        var entry = (this.inorder[n++] << 5) | len;
+        for (var i = rev; i < (1 << tbits); i += (1 << len)) {
+          table[i] = entry;
         }
       }
     }
+  };
 
-    // The Copy/Add commands.
-    for (var mode = 0; mode < cpyModes; mode++) {
-      var max = (mode < 2 + desc.near_modes) ?  //
-          desc.copyadd_near_cpy_max :
-          desc.copyadd_same_cpy_max;
-      for (var size1 = MIN_MATCH; size1 <= max; size1++) {
-        for (var size2 = 1; size2 <= desc.copyadd_add_max; size2++) {
-          tableRows[row].type1 = XD3_CPY + mode;
-          tableRows[row].size1 = size1;
-          tableRows[row].type2 = XD3_ADD;
-          tableRows[row++].size2 = size2;
+  /**
+   * The input of a DJW section. buf holds count bits, the next lowest.
+   * @param {!Uint8Array} input
+   * @constructor
+   * @struct
+   */
+  function xd3_djw_bits(input) {
+    this.input = input;
+    this.pos = 0;
+    this.buf = 0;
+    this.count = 0;
+  }
+
+  /**
+   * Fills buf to at least 25 bits, as far as the input goes.
+   */
+  xd3_djw_bits.prototype.fill = function() {
+    while (this.count <= 24 && this.pos < this.input.length) {
+      this.buf |= this.input[this.pos++] << this.count;
+      this.count += 8;
+    }
+  };
+
+  /**
+   * Reads an nbits value, most significant bit first.
+   * @param {number} nbits
+   * @return {number}
+   */
+  xd3_djw_bits.prototype.bits = function(nbits) {
+    this.fill();
+    if (nbits > this.count) {
+      throw new Error('secondary decoder end of input');
+    }
+    var value = 0;
+    for (var i = 0; i < nbits; i++) {
+      value = (value << 1) | (this.buf & 1);
+      this.buf >>>= 1;
+    }
+    this.count -= nbits;
+    return value;
+  };
+
+  /**
+   * Reads a symbol of the code.
+   * @param {!xd3_djw_code} code
+   * @return {number}
+   */
+  xd3_djw_bits.prototype.symbol = function(code) {
+    this.fill();
+    var entry = code.table[this.buf & code.mask];
+    var len = entry & 31;
+    if (entry != 0 && len <= this.count) {
+      this.buf >>>= len;
+      this.count -= len;
+      return entry >>> 5;
+    }
+    // A longer code, like the C djw_decode_symbol.
+    var value = 0;
+    for (len = 1; len <= code.max_len; len++) {
+      if (this.count == 0) {
+        throw new Error('secondary decoder end of input');
+      }
+      value = (value << 1) | (this.buf & 1);
+      this.buf >>>= 1;
+      this.count--;
+      if (len >= code.min_len && value <= code.limit[len]) {
+        return code.inorder[value - code.base[len]];
+      }
+    }
+    throw new Error('secondary decoder invalid code');
+  };
+
+  /**
+   * Reads elts move-to-front coded values, like the C djw_decode_1_2. A
+   * RUN_0 or RUN_1 symbol is a digit, 1 or 2, of the bijective base 2
+   * count of repeats of the front value, least significant first. A symbol
+   * s of DJW_RUN_CODES or more moves position s - 1 to the front.
+   *
+   * With skip_offset, the values of the later codes are 0 where the code
+   * skip_offset values earlier has 0, and are not coded.
+   * @param {!xd3_djw_code} code
+   * @param {!Uint8Array} mtf
+   * @param {!Uint8Array} values
+   * @param {number} elts
+   * @param {number} skip_offset
+   */
+  xd3_djw_bits.prototype.decode_1_2 = function(code, mtf, values, elts,
+                                               skip_offset) {
+    var n = 0;
+    var rep = 0;
+    var shift = 0;
+    while (n < elts) {
+      if (skip_offset != 0 && n >= skip_offset &&
+          values[n - skip_offset] == 0) {
+        values[n++] = 0;
+        continue;
+      }
+      if (rep != 0) {
+        values[n++] = mtf[0];
+        rep--;
+        continue;
+      }
+      var s = this.symbol(code);
+      if (s < DJW_RUN_CODES) {
+        if (shift > 24) {
+          throw new Error('secondary decoder invalid input');
         }
+        rep = (s + 1) << shift;
+        shift++;
+        continue;
       }
+      shift = 0;
+      var v = mtf[s - 1];
+      mtf.copyWithin(1, 0, s - 1);
+      mtf[0] = v;
+      values[n++] = v;
+    }
+    if (rep != 0) {
+      throw new Error('secondary decoder invalid input');
     }
+  };
 
-    return new xd3_dinst_table(tableRows);
+  /**
+   * The state of one section type, the codes and buffers to reuse.
+   * @constructor
+   * @struct
+   */
+  function xd3_djw_stream() {
+    /** @type {!Array<!xd3_djw_code>} */
+    this.codes = [];
+    for (var i = 0; i < DJW_MAX_GROUPS; i++) {
+      this.codes.push(new xd3_djw_code(DJW_ALPHABET_SIZE));
+    }
+    this.cl_code = new xd3_djw_code(DJW_TOTAL_CODES);
+    this.gb_code = new xd3_djw_code(DJW_MAX_GROUPS + 1);
+    this.clen = new Uint8Array(DJW_MAX_GROUPS * DJW_ALPHABET_SIZE);
+    this.mtf = new Uint8Array(DJW_MAX_CODELEN + 1);
+    this.sel = new Uint8Array(0);
   }
 
+  /**
+   * Decodes a section, like the C xd3_decode_djw.
+   * @param {!Uint8Array} input
+   * @param {!Uint8Array} output
+   * @return {number} The bytes written, all of output.
+   */
+  xd3_djw_stream.prototype.decode = function(input, output) {
+    var output_bytes = output.length;
+    if (output_bytes == 0) {
+      throw new Error('secondary decoder invalid input');
+    }
+    var bits = new xd3_djw_bits(input);
+    var groups = bits.bits(DJW_GROUP_BITS) + 1;
+    var sector_size = output_bytes;
+    if (groups > 1) {
+      sector_size = (bits.bits(DJW_SECTORSZ_BITS) + 1) * DJW_SECTORSZ_MULT;
+    }
+    var sectors = 1 + Math.floor((output_bytes - 1) / sector_size);
+
+    // The code length code, then the code lengths of every group.
+    var cl_clen = new Uint8Array(DJW_TOTAL_CODES);
+    var num_codes = bits.bits(DJW_EXTRA_CODE_BITS) + DJW_EXTRA_12OFFSET;
+    for (var i = 0; i < num_codes; i++) {
+      cl_clen[i] = bits.bits(DJW_CLCLEN_BITS);
+    }
+    this.cl_code.build(cl_clen, DJW_TOTAL_CODES, DJW_MAX_CLCLEN);
+    djw_init_clen_mtf_1_2(this.mtf);
+    var clen = this.clen;
+    bits.decode_1_2(this.cl_code, this.mtf, clen,
+        groups * DJW_ALPHABET_SIZE, DJW_ALPHABET_SIZE);
+    for (var gp = 0; gp < groups; gp++) {
+      this.codes[gp].build(clen.subarray(gp * DJW_ALPHABET_SIZE),
+          DJW_ALPHABET_SIZE, DJW_MAX_CODELEN);
+    }
+
+    // The group of each sector: its move-to-front code has RUN_0, RUN_1
+    // and the positions 1 to groups - 1.
+    var sel = this.sel;
+    if (groups > 1) {
+      var gb_clen = new Uint8Array(groups + 1);
+      for (var i = 0; i <= groups; i++) {
+        gb_clen[i] = bits.bits(DJW_GBCLEN_BITS);
+      }
+      this.gb_code.build(gb_clen, groups + 1, DJW_MAX_GBCLEN);
+      var gb_mtf = new Uint8Array(groups);
+      for (var i = 0; i < groups; i++) {
+        gb_mtf[i] = i;
+      }
+      if (sel.length < sectors) {
+        sel = this.sel = new Uint8Array(sectors);
+      }
+      bits.decode_1_2(this.gb_code, gb_mtf, sel, sectors, 0);
+    }
+
+    var o = 0;
+    var buf = bits.buf;
+    var count = bits.count;
+    var pos = bits.pos;
+    var input_end = input.length;
+    for (var c = 0; c < sectors; c++) {
+      var code = this.codes[groups > 1 ? sel[c] : 0];
+      var table = code.table;
+      var mask = code.mask;
+      var end = Math.min(o + sector_size, output_bytes);
+      while (o < end) {
+        while (count <= 24 && pos < input_end) {
+          buf |= input[pos++] << count;
+          count += 8;
+        }
+        var entry = table[buf & mask];
+        var len = entry & 31;
+        if (entry != 0 && len <= count) {
+          buf >>>= len;
+          count -= len;
+          output[o++] = entry >>> 5;
+        } else {
+          bits.buf = buf;
+          bits.count = count;
+          bits.pos = pos;
+          output[o++] = bits.symbol(code);
+          buf = bits.buf;
+          count = bits.count;
+          pos = bits.pos;
+        }
+      }
+    }
+
+    // The last byte may be partly used.
+    if (pos - (count >> 3) != input_end) {
+      throw new Error('secondary decoder finished with unused input');
+    }
+    return output_bytes;
+  };
+
+  xd3_sec_types[VCD_DJW_ID] = {
+    id: VCD_DJW_ID,
+    name: 'DJW Static Huffman',
+    alloc: function() {
+      return new xd3_djw_stream();
+    },
+    decode: function(stream, input, output) {
+      return stream.decode(input, output);
+    },
+    independent: true
+  };
 
   /**
-   * @constructor
+   * The zstd secondary compressor.
+   *
+   * Each compressed section holds one or more zstd frames (RFC 8878). Frames
+   * do not depend on each other, so the sections of a window decode without
+   * the earlier windows. A frame may name a dictionary that was added with
+   * XDelta3Decoder.addZstdDictionary.
+   *
+   * Huffman literals are decoded with one table lookup per symbol, indexed
+   * by the next Huffman_Log bits, and the sequences are executed as they
+   * are decoded. The frame checksum is not verified; VCD_ADLER32 covers the
+   * target. The decoder state is kept per section only to reuse its
+   * buffers.
    */
-  function xd3_code_table_desc() {
-    this.add_sizes = 0;
-    this.near_modes = 0;
-    this.same_modes = 0;
-    this.cpy_sizes = 0;
 
-    this.addcopy_add_max = 0;
-    this.addcopy_near_cpy_max = 0;
-    this.addcopy_same_cpy_max = 0;
+  /**
+   * The registered zstd dictionaries, by dictionary ID.
+   * @type {!Object<number, !xd3_zstd_dict>}
+   */
+  var xd3_zstd_dicts = {};
 
-    this.copyadd_add_max = 0;
-    this.copyadd_near_cpy_max = 0;
-    this.copyadd_same_cpy_max = 0;
+  /** @type {number} */
+  var ZSTD_MAGIC = 0xFD2FB528;
+  /** @type {number} */
+  var ZSTD_DICT_MAGIC = 0xEC30A437;
+  /** @type {number} */
+  var ZSTD_BLOCKSIZE_MAX = 1 << 17;
+  /** @type {number} */
+  var ZSTD_HUF_LOG_MAX = 11;
+
+  /**
+   * The Literals_Length and Match_Length codes: the baseline and the number
+   * of extra bits of each code.
+   */
+  var ZSTD_LL_BASE = [
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048, 4096,
+    8192, 16384, 32768, 65536];
+  var ZSTD_LL_BITS = [
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+    13, 14, 15, 16];
+  var ZSTD_ML_BASE = [
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+    19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+    35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051,
+    4099, 8195, 16387, 32771, 65539];
+  var ZSTD_ML_BITS = [
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+    12, 13, 14, 15, 16];
+  var ZSTD_OF_BASE = [];
+  var ZSTD_OF_BITS = [];
+  for (var i = 0; i < 32; i++) {
+    ZSTD_OF_BASE.push(Math.pow(2, i));
+    ZSTD_OF_BITS.push(i);
   }
 
+  /**
+   * The predefined distributions of the sequence codes.
+   */
+  var ZSTD_LL_DEFAULT = [
+    4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+    -1, -1, -1, -1];
+  var ZSTD_ML_DEFAULT = [
+    1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+    -1, -1, -1, -1, -1];
+  var ZSTD_OF_DEFAULT = [
+    1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1];
 
   /**
-   * This builds the __rfc3284_code_table_desc
-   * Assumes a single RUN instruction
-   * Assumes that MIN_MATCH is 4.
-   * @return {!xd3_code_table_desc}
+   * Which sequence code a table decodes: its largest accuracy log, its
+   * largest symbol and the values of its symbols.
+   * @param {number} max_log
+   * @param {!Array<number>} base
+   * @param {!Array<number>} bits
+   * @param {!Array<number>} defaults
+   * @param {number} default_log
+   * @constructor
+   * @struct
    */
-  function build_rfc3284_code_table_desc() {
-    var desc = new xd3_code_table_desc();
-    desc.add_sizes = 17;
-    desc.near_modes = 4;
-    desc.same_modes = 3;
-    desc.cpy_sizes = 15;
+  function xd3_zstd_code(max_log, base, bits, defaults, default_log) {
+    this.max_log = max_log;
+    this.max_symbol = base.length - 1;
+    this.base = base;
+    this.bits = bits;
+    this.predefined = new xd3_zstd_fse(this);
+    this.predefined.build(defaults, defaults.length, default_log);
+  }
 
-    desc.addcopy_add_max = 4;
-    desc.addcopy_near_cpy_max = 6;
-    desc.addcopy_same_cpy_max = 4;
+  /**
+   * @param {string} what
+   * @return {!Error}
+   */
+  function xd3_zstd_error(what) {
+    return new Error('zstd secondary decoder: ' + what);
+  }
 
-    desc.copyadd_add_max = 1;
-    desc.copyadd_near_cpy_max = 4;
-    desc.copyadd_same_cpy_max = 4;
+  /**
+   * An FSE decoding table. Each state holds its symbol, the number of bits
+   * to read for the next state and the state they are added to. Sequence
+   * code tables also hold the symbol's baseline and extra bits.
+   * @param {!xd3_zstd_code|number} code The sequence code, or the largest
+   *     accuracy log of a table of Huffman weights.
+   * @constructor
+   * @struct
+   */
+  function xd3_zstd_fse(code) {
+    var max_log = (typeof code == 'number') ? code : code.max_log;
+    var size = 1 << max_log;
+    /** @type {?xd3_zstd_code} */
+    this.code = (typeof code == 'number') ? null : code;
+    /** @type {number} */
+    this.log = 0;
+    this.symbol = new Uint8Array(size);
+    this.nbits = new Uint8Array(size);
+    this.state = new Uint16Array(size);
+    this.base = new Float64Array(this.code ? size : 0);
+    this.extra = new Uint8Array(this.code ? size : 0);
+  }
 
-    // xd3_code_table_sizes addcopy_max_sizes[MAX_MODES];
-    // { {6,163,3},{6,175,3},{6,187,3},{6,199,3},{6,211,3},{6,223,3},
-    // {4,235,1},{4,239,1},{4,243,1} },
+  /**
+   * Builds the table from normalized counts.
+   * @param {!Array<number>|!Int16Array} norm The counts, -1 for a "less than
+   *     one" probability.
+   * @param {number} nsym The number of symbols in norm.
+   * @param {number} log The accuracy log.
+   */
+  xd3_zstd_fse.prototype.build = function(norm, nsym, log) {
+    var size = 1 << log;
+    var high = size - 1;
+    var next = new Uint16Array(nsym);
+    for (var s = 0; s < nsym; s++) {
+      if (norm[s] == -1) {
+        this.symbol[high--] = s;
+        next[s] = 1;
+      } else {
+        next[s] = norm[s];
+      }
+    }
+    var step = (size >> 1) + (size >> 3) + 3;
+    var mask = size - 1;
+    var p = 0;
+    for (var s = 0; s < nsym; s++) {
+      for (var i = 0; i < norm[s]; i++) {
+        this.symbol[p] = s;
+        do {
+          p = (p + step) & mask;
+        } while (p > high);
+      }
+    }
+    if (p != 0) {
+      throw xd3_zstd_error('invalid FSE table');
+    }
+    for (var u = 0; u < size; u++) {
+      var sym = this.symbol[u];
+      var ns = next[sym]++;
+      var nb = log - (31 - Math.clz32(ns));
+      this.nbits[u] = nb;
+      this.state[u] = (ns << nb) - size;
+    }
+    this.log = log;
+    if (this.code) {
+      for (var u = 0; u < size; u++) {
+        this.base[u] = this.code.base[this.symbol[u]];
+        this.extra[u] = this.code.bits[this.symbol[u]];
+      }
+    }
+  };
 
-    // xd3_code_table_sizes copyadd_max_sizes[MAX_MODES];
-    // { {4,247,1},{4,248,1},{4,249,1},{4,250,1},{4,251,1},{4,252,1},
-    // {4,253,1},{4,254,1},{4,255,1} },
+  /**
+   * Makes a table that always decodes one symbol (the RLE mode).
+   * @param {number} sym
+   */
+  xd3_zstd_fse.prototype.rle = function(sym) {
+    this.log = 0;
+    this.symbol[0] = sym;
+    this.nbits[0] = 0;
+    this.state[0] = 0;
+    if (this.code) {
+      this.base[0] = this.code.base[sym];
+      this.extra[0] = this.code.bits[sym];
+    }
+  };
 
-    return desc;
-  }
+  /**
+   * Reads an FSE table description and builds the table.
+   * @param {!Uint8Array} src
+   * @param {number} pos
+   * @param {number} end
+   * @param {number} max_symbol
+   * @param {!Int16Array} norm Scratch space for the counts.
+   * @return {number} The position after the description.
+   */
+  xd3_zstd_fse.prototype.read = function(src, pos, end, max_symbol, norm) {
+    var bitpos = pos * 8;
+    var peek = function(n) {
+      var b = bitpos >> 3;
+      return ((src[b] | (src[b + 1] << 8) | (src[b + 2] << 16)) >>>
+              (bitpos & 7)) & ((1 << n) - 1);
+    };
+    var max_log = 31 - Math.clz32(this.symbol.length);
+    var log = peek(4) + 5;
+    bitpos += 4;
+    if (log > max_log) {
+      throw xd3_zstd_error('FSE accuracy log too large');
+    }
+    var remaining = (1 << log) + 1;
+    var threshold = 1 << log;
+    var nbits = log + 1;
+    var sym = 0;
+    var previous0 = false;
+    while (remaining > 1 && sym <= max_symbol) {
+      if (previous0) {
+        var n0 = sym;
+        while (peek(2) == 3) {
+          n0 += 3;
+          bitpos += 2;
+        }
+        n0 += peek(2);
+        bitpos += 2;
+        if (n0 > max_symbol) {
+          throw xd3_zstd_error('FSE symbol out of range');
+        }
+        while (sym < n0) {
+          norm[sym++] = 0;
+        }
+      }
+      var max = (2 * threshold - 1) - remaining;
+      var v = peek(nbits);
+      var count;
+      if ((v & (threshold - 1)) < max) {
+        count = v & (threshold - 1);
+        bitpos += nbits - 1;
+      } else {
+        count = v & (2 * threshold - 1);
+        if (count >= threshold) {
+          count -= max;
+        }
+        bitpos += nbits;
+      }
+      count--;
+      remaining -= (count < 0) ? -count : count;
+      norm[sym++] = count;
+      previous0 = (count == 0);
+      if (remaining < 1) {
+        break;
+      }
+      while (remaining < threshold) {
+        nbits--;
+        threshold >>= 1;
+      }
+    }
+    pos = (bitpos + 7) >> 3;
+    if (remaining != 1 || pos > end) {
+      throw xd3_zstd_error('invalid FSE table description');
+    }
+    this.build(norm, sym, log);
+    return pos;
+  };
 
-  var __rfc3284_code_table_desc = build_rfc3284_code_table_desc();
+  /**
+   * Reads a bitstream backward from its end, as FSE and Huffman streams are
+   * written. Bits before the start of the stream read as zeros; avail goes
+   * negative when they are read.
+   * @param {!Uint8Array} src
+   * @param {number} start
+   * @param {number} end
+   * @constructor
+   * @struct
+   */
+  function xd3_zstd_bits(src, start, end) {
+    if (end <= start || src[end - 1] == 0) {
+      throw xd3_zstd_error('invalid bitstream');
+    }
+    this.src = src;
+    this.start = start;
+    /**
+     * The number of bits not read yet.
+     * @type {number}
+     */
+    this.avail = (end - 1 - start) * 8 + 31 - Math.clz32(src[end - 1]);
+  }
 
-  var A32_BASE = 65521; /* Largest prime smaller than 2^16 */
-  var A32_NMAX = 5552;  /* NMAX is the largest n such that 255n(n+1)/2
-                            + (n+1)(BASE-1) <= 2^32-1 */
+  /**
+   * @param {number} n At most 25.
+   * @return {number} The next n bits.
+   */
+  xd3_zstd_bits.prototype.read = function(n) {
+    var pos = (this.avail -= n);
+    var src = this.src;
+    var b;
+    if (pos >= 0) {
+      b = this.start + (pos >> 3);
+      return ((src[b] | (src[b + 1] << 8) | (src[b + 2] << 16) |
+               (src[b + 3] << 24)) >>> (pos & 7)) & ((1 << n) - 1);
+    }
+    if (n + pos <= 0) {
+      return 0;
+    }
+    b = this.start;
+    return ((src[b] | (src[b + 1] << 8) | (src[b + 2] << 16)) &
+            ((1 << (n + pos)) - 1)) << -pos;
+  };
 
-  // 1140 #define A32_DO1(buf,i)  {s1 += buf[i]; s2 += s1;}
-  // 1141 #define A32_DO2(buf,i)  A32_DO1(buf,i); A32_DO1(buf,i+1);
-  // 1142 #define A32_DO4(buf,i)  A32_DO2(buf,i); A32_DO2(buf,i+2);
-  // 1143 #define A32_DO8(buf,i)  A32_DO4(buf,i); A32_DO4(buf,i+4);
-  // 1144 #define A32_DO16(buf)   A32_DO8(buf,0); A32_DO8(buf,8);
+  /**
+   * @param {number} n At most 32.
+   * @return {number} The next n bits.
+   */
+  xd3_zstd_bits.prototype.read_long = function(n) {
+    if (n <= 25) {
+      return this.read(n);
+    }
+    var high = this.read(n - 16);
+    return high * 65536 + this.read(16);
+  };
 
+  /**
+   * Huffman decoding tables, indexed by the next log bits. Each entry of
+   * table is the symbol and, above it, the length of its code. Each entry
+   * of table2 is the two symbols whose codes fit in the log bits, or one,
+   * then the length of their codes and the number of symbols.
+   * @constructor
+   * @struct
+   */
+  function xd3_zstd_huf() {
+    /** @type {number} */
+    this.log = 0;
+    this.table = new Uint16Array(1 << ZSTD_HUF_LOG_MAX);
+    this.table2 = new Uint32Array(1 << ZSTD_HUF_LOG_MAX);
+  }
 
   /**
-   * Calculated the Adler32 checksum.
-   * @param {number} adler I'm not sure what this is.
-   * @param {!Uint8Array} buf
+   * Reads a Huffman tree description and builds the table.
+   * @param {!Uint8Array} src
    * @param {number} pos
-   * @param {number} len
-   * @return {number}
+   * @param {number} end
+   * @param {!xd3_zstd_stream} stream For its scratch space.
+   * @return {number} The position after the description.
    */
-  function adler32(adler, buf, pos, len) {
-    var s1 = adler & 0xffff;
-    var s2 = (adler >> 16) & 0xffff;
-    var k;
-
-    while (len > 0) {
-      k = (len < A32_NMAX) ? len : A32_NMAX;
-      len -= k;
-
-      if (k != 0) {
-        do {
-          s1 += buf[pos++];
-          s2 += s1;
-        } while (--k);
+  xd3_zstd_huf.prototype.read = function(src, pos, end, stream) {
+    var weights = stream.weights;
+    var n = 0;
+    var header = src[pos++];
+    if (header < 128) {
+      // FSE compressed weights, two interleaved states.
+      var wend = pos + header;
+      if (wend > end) {
+        throw xd3_zstd_error('Huffman description exceeds block');
       }
-
-      s1 %= A32_BASE;
-      s2 %= A32_BASE;
+      var fse = stream.weight_fse;
+      var bits = new xd3_zstd_bits(src, fse.read(src, pos, wend, 255,
+          stream.norm), wend);
+      var s1 = bits.read(fse.log);
+      var s2 = bits.read(fse.log);
+      while (true) {
+        if (n > 253) {
+          throw xd3_zstd_error('too many Huffman weights');
+        }
+        weights[n++] = fse.symbol[s1];
+        s1 = fse.state[s1] + bits.read(fse.nbits[s1]);
+        if (bits.avail < 0) {
+          weights[n++] = fse.symbol[s2];
+          break;
+        }
+        if (n > 253) {
+          throw xd3_zstd_error('too many Huffman weights');
+        }
+        weights[n++] = fse.symbol[s2];
+        s2 = fse.state[s2] + bits.read(fse.nbits[s2]);
+        if (bits.avail < 0) {
+          weights[n++] = fse.symbol[s1];
+          break;
+        }
+      }
+      pos = wend;
+    } else {
+      // Direct 4 bit weights.
+      n = header - 127;
+      if (pos + ((n + 1) >> 1) > end) {
+        throw xd3_zstd_error('Huffman description exceeds block');
+      }
+      for (var i = 0; i < n; i++) {
+        var b = src[pos + (i >> 1)];
+        weights[i] = (i & 1) ? (b & 15) : (b >> 4);
+      }
+      pos += (n + 1) >> 1;
     }
 
-    return (s2 << 16) | s1;
-  }
+    // The last weight makes the total a power of two.
+    var rank_count = stream.rank;
+    rank_count.fill(0);
+    var total = 0;
+    for (var i = 0; i < n; i++) {
+      if (weights[i] > ZSTD_HUF_LOG_MAX) {
+        throw xd3_zstd_error('invalid Huffman weight');
+      }
+      rank_count[weights[i]]++;
+      total += (1 << weights[i]) >> 1;
+    }
+    if (total == 0) {
+      throw xd3_zstd_error('invalid Huffman weights');
+    }
+    var log = 32 - Math.clz32(total);
+    var rest = (1 << log) - total;
+    if (log > ZSTD_HUF_LOG_MAX || (rest & (rest - 1)) != 0) {
+      throw xd3_zstd_error('invalid Huffman weights');
+    }
+    var last = 32 - Math.clz32(rest);
+    weights[n++] = last;
+    rank_count[last]++;
+
+    // Codes of weight 1 come first, then weight 2, in symbol order.
+    var next = 0;
+    for (var w = 1; w <= log; w++) {
+      var count = rank_count[w];
+      rank_count[w] = next;
+      next += count << (w - 1);
+    }
+    var table = this.table;
+    for (var s = 0; s < n; s++) {
+      var w = weights[s];
+      if (w == 0) {
+        continue;
+      }
+      var start = rank_count[w];
+      var len = 1 << (w - 1);
+      table.fill(s | ((log + 1 - w) << 8), start, start + len);
+      rank_count[w] = start + len;
+    }
 
+    // The second symbol's code follows the first one's in the index.
+    var size = 1 << log;
+    var table2 = this.table2;
+    for (var i = 0; i < size; i++) {
+      var e1 = table[i];
+      var len1 = e1 >> 8;
+      var e2 = table[(i << len1) & (size - 1)];
+      var len2 = e2 >> 8;
+      if (len1 + len2 <= log) {
+        table2[i] = (e1 & 0xff) | ((e2 & 0xff) << 8) |
+            ((len1 + len2) << 16) | (2 << 24);
+      } else {
+        table2[i] = (e1 & 0xff) | (len1 << 16) | (1 << 24);
+      }
+    }
+    this.log = log;
+    return pos;
+  };
 
   /**
-   * @constructor
+   * Decodes the four interleaved Huffman streams of a literals section.
+   * The streams do not depend on each other, so decoding them in the same
+   * loop overlaps their table lookups.
+   * @param {!Uint8Array} src
+   * @param {number} pos Where the jump table starts.
+   * @param {number} end
+   * @param {!Uint8Array} lits
+   * @param {number} regen The number of literals.
    */
-  function xd3_addr_cache(s_near, s_same) {
-    this.s_near = s_near;
-    this.s_same = s_same;
-    this.next_slot = 0; /* the circular index for near */
-    this.near_array = null;    /* array of size s_near        */
-    this.same_array = null;    /* array of size s_same*256    */
-  }
-
+  xd3_zstd_huf.prototype.decode_streams = function(src, pos, end, lits,
+      regen) {
+    if (pos + 6 > end) {
+      throw xd3_zstd_error('invalid jump table');
+    }
+    var s1 = pos + 6;
+    var s2 = s1 + (src[pos] | (src[pos + 1] << 8));
+    var s3 = s2 + (src[pos + 2] | (src[pos + 3] << 8));
+    var s4 = s3 + (src[pos + 4] | (src[pos + 5] << 8));
+    var seg = (regen + 3) >> 2;
+    if (s4 > end || 3 * seg > regen) {
+      throw xd3_zstd_error('invalid jump table');
+    }
+    var a1 = new xd3_zstd_bits(src, s1, s2).avail;
+    var a2 = new xd3_zstd_bits(src, s2, s3).avail;
+    var a3 = new xd3_zstd_bits(src, s3, s4).avail;
+    var a4 = new xd3_zstd_bits(src, s4, end).avail;
+    var o1 = 0;
+    var o2 = seg;
+    var o3 = 2 * seg;
+    var o4 = 3 * seg;
+    var log = this.log;
+    var mask = (1 << log) - 1;
+    var table2 = this.table2;
+    var p;
+    var b;
+    var e;
+    while (a1 >= log && a2 >= log && a3 >= log && a4 >= log &&
+           o1 < seg - 1 && o2 < 2 * seg - 1 && o3 < 3 * seg - 1 &&
+           o4 < regen - 1) {
+      p = a1 - log;
+      b = s1 + (p >> 3);
+      e = table2[((src[b] | (src[b + 1] << 8) | (src[b + 2] << 16)) >>>
+                  (p & 7)) & mask];
+      lits[o1] = e;
+      lits[o1 + 1] = e >>> 8;
+      o1 += e >>> 24;
+      a1 -= (e >>> 16) & 0xff;
+
+      p = a2 - log;
+      b = s2 + (p >> 3);
+      e = table2[((src[b] | (src[b + 1] << 8) | (src[b + 2] << 16)) >>>
+                  (p & 7)) & mask];
+      lits[o2] = e;
+      lits[o2 + 1] = e >>> 8;
+      o2 += e >>> 24;
+      a2 -= (e >>> 16) & 0xff;
+
+      p = a3 - log;
+      b = s3 + (p >> 3);
+      e = table2[((src[b] | (src[b + 1] << 8) | (src[b + 2] << 16)) >>>
+                  (p & 7)) & mask];
+      lits[o3] = e;
+      lits[o3 + 1] = e >>> 8;
+      o3 += e >>> 24;
+      a3 -= (e >>> 16) & 0xff;
+
+      p = a4 - log;
+      b = s4 + (p >> 3);
+      e = table2[((src[b] | (src[b + 1] << 8) | (src[b + 2] << 16)) >>>
+                  (p & 7)) & mask];
+      lits[o4] = e;
+      lits[o4 + 1] = e >>> 8;
+      o4 += e >>> 24;
+      a4 -= (e >>> 16) & 0xff;
+    }
+    this.decode_stream(src, s1, a1, lits, o1, seg);
+    this.decode_stream(src, s2, a2, lits, o2, 2 * seg);
+    this.decode_stream(src, s3, a3, lits, o3, 3 * seg);
+    this.decode_stream(src, s4, a4, lits, o4, regen);
+  };
 
   /**
-   * @param {!xd3_addr_cache} acache
+   * Decodes a Huffman stream, or the rest of one, into lits.
+   * @param {!Uint8Array} src
+   * @param {number} start Where the stream starts.
+   * @param {number} avail The number of bits left in the stream.
+   * @param {!Uint8Array} lits
+   * @param {number} op Where the stream's literals go.
+   * @param {number} oend
    */
-  function xd3_init_cache(acache) {
-    if (acache.s_near > 0) {
-      for (var i = 0; i < acache.near_array.length; i++) {
-        acache.near_array[i] = 0;
+  xd3_zstd_huf.prototype.decode_stream = function(src, start, avail, lits, op,
+      oend) {
+    var log = this.log;
+    var mask = (1 << log) - 1;
+    var table = this.table;
+    var table2 = this.table2;
+
+    // Two symbols per lookup while a whole index is left in the stream.
+    while (op < oend - 1) {
+      var pos = avail - log;
+      if (pos < 0) {
+        break;
       }
-      acache.next_slot = 0;
+      var b = start + (pos >> 3);
+      var e = table2[((src[b] | (src[b + 1] << 8) | (src[b + 2] << 16)) >>>
+                      (pos & 7)) & mask];
+      lits[op] = e;
+      lits[op + 1] = e >>> 8;
+      op += e >>> 24;
+      avail -= (e >>> 16) & 0xff;
     }
 
-    if (acache.s_same > 0) {
-      for (var i = 0; i < acache.same_array.length; i++) {
-        acache.same_array[i] = 0;
+    // The last symbols, which may be indexed with bits before the start.
+    var b0 = src[start] | (src[start + 1] << 8) | (src[start + 2] << 16);
+    while (op < oend) {
+      var pos = avail - log;
+      var v;
+      if (pos >= 0) {
+        var b = start + (pos >> 3);
+        v = (src[b] | (src[b + 1] << 8) | (src[b + 2] << 16)) >>> (pos & 7);
+      } else if (pos > -log) {
+        v = b0 << -pos;
+      } else {
+        break;
       }
+      var e = table[v & mask];
+      lits[op++] = e;
+      avail -= e >> 8;
     }
-  }
+    if (avail != 0 || op != oend) {
+      throw xd3_zstd_error('invalid Huffman stream');
+    }
+  };
 
   /**
-   * Used by the decoder to buffer input in sections.
-   * XDelta3 C++ struct.
+   * A dictionary: its content and the entropy tables and repeat offsets
+   * that the frames using it start with.
    * @constructor
    * @struct
    */
-  function xd3_desect() {
+  function xd3_zstd_dict() {
+    /** @type {number} */
+    this.id = 0;
     /**
-     * The buffer as a slice of the backingBuffer;
-     * @type {?Uint8Array}
+     * The dictionary as it was added, for the decodeParallel workers.
+     * @type {!Uint8Array}
      */
-    this.bytes = null;
+    this.bytes = new Uint8Array(0);
+    /** @type {!Uint8Array} */
+    this.content = new Uint8Array(0);
+    /** @type {?xd3_zstd_huf} */
+    this.huf = null;
+    /** @type {?xd3_zstd_fse} */
+    this.ll = null;
+    /** @type {?xd3_zstd_fse} */
+    this.of = null;
+    /** @type {?xd3_zstd_fse} */
+    this.ml = null;
+    /** @type {!Array<number>} */
+    this.reps = [1, 4, 8];
+  }
 
+  /**
+   * The state of one section type: the entropy tables and repeat offsets of
+   * the current frame and the literals buffer.
+   * @constructor
+   * @struct
+   */
+  function xd3_zstd_stream() {
+    this.lits = new Uint8Array(ZSTD_BLOCKSIZE_MAX);
+    /** @type {!Uint8Array} */
+    this.lit_src = this.lits;
     /** @type {number} */
-    this.size = 0;
-
+    this.lit_pos = 0;
     /** @type {number} */
-    this.pos = 0;
+    this.lit_end = 0;
+
+    this.huf_table = new xd3_zstd_huf();
+    this.ll_table = new xd3_zstd_fse(xd3_zstd_codes.ll);
+    this.of_table = new xd3_zstd_fse(xd3_zstd_codes.of);
+    this.ml_table = new xd3_zstd_fse(xd3_zstd_codes.ml);
+    this.weight_fse = new xd3_zstd_fse(6);
+    this.norm = new Int16Array(256);
+    this.weights = new Uint8Array(256);
+    this.rank = new Uint16Array(ZSTD_HUF_LOG_MAX + 2);
+
+    /**
+     * The tables for Treeless literals and Repeat_Mode sequences.
+     * @type {?xd3_zstd_huf}
+     */
+    this.huf = null;
+    /** @type {?xd3_zstd_fse} */
+    this.ll = null;
+    /** @type {?xd3_zstd_fse} */
+    this.of = null;
+    /** @type {?xd3_zstd_fse} */
+    this.ml = null;
+    this.reps = [1, 4, 8];
+
+    /**
+     * The dictionary content before the frame's output.
+     * @type {!Uint8Array}
+     */
+    this.prefix = this.lits.subarray(0, 0);
+
+    /**
+     * The table select_table selected.
+     * @type {?xd3_zstd_fse}
+     */
+    this.selected = null;
+
+    /**
+     * The end of the output of decode_frame.
+     * @type {number}
+     */
+    this.op = 0;
   }
 
   /**
-   * Gets a byte from the section.
-   * @return {number}
+   * Decodes the frames of a section.
+   * @param {!Uint8Array} input
+   * @param {!Uint8Array} output
+   * @return {number} The number of bytes decoded.
    */
-  xd3_desect.prototype.getByte = function() {
-    if (!this.bytes) {
-      throw new Error('bytes not set');
+  xd3_zstd_stream.prototype.decode = function(input, output) {
+    var pos = 0;
+    var op = 0;
+    while (pos < input.length) {
+      if (pos + 4 > input.length) {
+        throw xd3_zstd_error('truncated frame');
+      }
+      var magic = xd3_zstd_read32(input, pos);
+      if ((magic & 0xFFFFFFF0) >>> 0 == 0x184D2A50) {
+        // A skippable frame.
+        pos += 8 + xd3_zstd_read32(input, pos + 4);
+        continue;
+      }
+      if (magic != ZSTD_MAGIC) {
+        throw xd3_zstd_error('unknown frame magic');
+      }
+      pos = this.decode_frame(input, pos + 4, output, op);
+      op = this.op;
     }
-    return this.bytes[this.pos++];
+    if (pos != input.length) {
+      throw new Error('secondary decoder finished with unused input');
+    }
+    return op;
   };
 
   /**
-   * Gets an integer from the section.
-   * XDelta3 integers are encodes as a variable number of 7 bit bytes. Bit 8, the
-   * most significant bit is used to indicate more bytes needed.
-   * @return {number}
+   * Decodes a frame after its magic number, leaving the end of its output
+   * in this.op.
+   * @param {!Uint8Array} src
+   * @param {number} pos
+   * @param {!Uint8Array} out
+   * @param {number} op
+   * @return {number} The position after the frame.
    */
-  xd3_desect.prototype.getInteger = function() {
-    if (!this.bytes) {
-      throw new Error('bytes not set');
+  xd3_zstd_stream.prototype.decode_frame = function(src, pos, out, op) {
+    var fhd = src[pos++];
+    var fcs_flag = fhd >> 6;
+    var single_segment = (fhd >> 5) & 1;
+    var checksum = (fhd >> 2) & 1;
+    var dict_flag = fhd & 3;
+    if (fhd & 8) {
+      throw xd3_zstd_error('reserved frame header bit set');
     }
-    var val = 0;
-    for (var i = 0; i < 10; i++) {
-      var aByte = this.bytes[this.pos++];
-      val += aByte & 0x7F;
-      if (!(aByte & 0x80)) {
-        return val;
+    if (!single_segment) {
+      pos++;  // Window_Descriptor, the whole section is the window.
+    }
+    var dict_id = 0;
+    var nbytes = [0, 1, 2, 4][dict_flag];
+    for (var i = 0; i < nbytes; i++) {
+      dict_id += src[pos++] * Math.pow(256, i);
+    }
+    var fcs = -1;
+    nbytes = [single_segment, 2, 4, 8][fcs_flag];
+    if (nbytes) {
+      fcs = 0;
+      for (var i = 0; i < nbytes; i++) {
+        fcs += src[pos++] * Math.pow(256, i);
+      }
+      if (nbytes == 2) {
+        fcs += 256;
+      }
+      if (op + fcs > out.length) {
+        throw xd3_zstd_error('frame exceeds the section');
       }
-      val <<= 7;
     }
-    throw new Error('invalid number');
+
+    var dict = null;
+    if (dict_id) {
+      dict = xd3_zstd_dicts[dict_id];
+      if (!dict) {
+        throw xd3_zstd_error('unknown dictionary ' + dict_id);
+      }
+    }
+    this.huf = dict ? dict.huf : null;
+    this.ll = dict ? dict.ll : null;
+    this.of = dict ? dict.of : null;
+    this.ml = dict ? dict.ml : null;
+    this.reps[0] = dict ? dict.reps[0] : 1;
+    this.reps[1] = dict ? dict.reps[1] : 4;
+    this.reps[2] = dict ? dict.reps[2] : 8;
+    this.prefix = dict ? dict.content : this.lits.subarray(0, 0);
+
+    var frame_start = op;
+    var last = 0;
+    while (!last) {
+      if (pos + 3 > src.length) {
+        throw xd3_zstd_error('truncated block');
+      }
+      var header = src[pos] | (src[pos + 1] << 8) | (src[pos + 2] << 16);
+      pos += 3;
+      last = header & 1;
+      var size = header >> 3;
+      switch ((header >> 1) & 3) {
+        case 0:  // Raw_Block
+          if (pos + size > src.length || op + size > out.length) {
+            throw xd3_zstd_error('invalid raw block');
+          }
+          out.set(src.subarray(pos, pos + size), op);
+          pos += size;
+          op += size;
+          break;
+        case 1:  // RLE_Block
+          if (pos >= src.length || op + size > out.length) {
+            throw xd3_zstd_error('invalid RLE block');
+          }
+          out.fill(src[pos++], op, op + size);
+          op += size;
+          break;
+        case 2:  // Compressed_Block
+          if (size > ZSTD_BLOCKSIZE_MAX || pos + size > src.length) {
+            throw xd3_zstd_error('invalid compressed block');
+          }
+          op = this.decode_block(src, pos, pos + size, out, op, frame_start);
+          pos += size;
+          break;
+        default:
+          throw xd3_zstd_error('reserved block type');
+      }
+    }
+    if (fcs >= 0 && op - frame_start != fcs) {
+      throw xd3_zstd_error('wrong frame content size');
+    }
+    if (checksum) {
+      pos += 4;
+    }
+    this.op = op;
+    return pos;
   };
 
+  /**
+   * Decodes the literals section of a block into this.lit_src, lit_pos and
+   * lit_end.
+   * @param {!Uint8Array} src
+   * @param {number} pos
+   * @param {number} end
+   * @return {number} The position after the literals section.
+   */
+  xd3_zstd_stream.prototype.decode_literals = function(src, pos, end) {
+    var b0 = src[pos];
+    var type = b0 & 3;
+    var size_format = (b0 >> 2) & 3;
+    var regen;
+
+    if (type < 2) {
+      // Raw_Literals_Block or RLE_Literals_Block.
+      if ((size_format & 1) == 0) {
+        regen = b0 >> 3;
+        pos += 1;
+      } else if (size_format == 1) {
+        regen = (b0 >> 4) + (src[pos + 1] << 4);
+        pos += 2;
+      } else {
+        regen = (b0 >> 4) + (src[pos + 1] << 4) + (src[pos + 2] << 12);
+        pos += 3;
+      }
+      if (regen > ZSTD_BLOCKSIZE_MAX) {
+        throw xd3_zstd_error('literals too long');
+      }
+      if (type == 0) {
+        if (pos + regen > end) {
+          throw xd3_zstd_error('literals exceed block');
+        }
+        this.lit_src = src;
+        this.lit_pos = pos;
+        this.lit_end = pos + regen;
+        return pos + regen;
+      }
+      if (pos >= end) {
+        throw xd3_zstd_error('literals exceed block');
+      }
+      this.lits.fill(src[pos], 0, regen);
+      this.lit_src = this.lits;
+      this.lit_pos = 0;
+      this.lit_end = regen;
+      return pos + 1;
+    }
+
+    // Compressed_Literals_Block or Treeless_Literals_Block.
+    var h = xd3_zstd_read32(src, pos);
+    var comp;
+    var streams = (size_format == 0) ? 1 : 4;
+    if (size_format < 2) {
+      regen = (h >>> 4) & 0x3FF;
+      comp = (h >>> 14) & 0x3FF;
+      pos += 3;
+    } else if (size_format == 2) {
+      regen = (h >>> 4) & 0x3FFF;
+      comp = h >>> 18;
+      pos += 4;
+    } else {
+      regen = (h >>> 4) & 0x3FFFF;
+      comp = (h >>> 22) + (src[pos + 4] << 10);
+      pos += 5;
+    }
+    var cend = pos + comp;
+    if (regen > ZSTD_BLOCKSIZE_MAX || cend > end) {
+      throw xd3_zstd_error('literals exceed block');
+    }
+    if (type == 2) {
+      pos = this.huf_table.read(src, pos, cend, this);
+      this.huf = this.huf_table;
+    } else if (!this.huf) {
+      throw xd3_zstd_error('treeless literals without a Huffman table');
+    }
+    var huf = this.huf;
+    var lits = this.lits;
+    if (streams == 1) {
+      huf.decode_stream(src, pos, new xd3_zstd_bits(src, pos, cend).avail,
+          lits, 0, regen);
+    } else {
+      huf.decode_streams(src, pos, cend, lits, regen);
+    }
+    this.lit_src = lits;
+    this.lit_pos = 0;
+    this.lit_end = regen;
+    return cend;
+  };
 
   /**
-   * Builds a default code table.
-   * @return {!xd3_dinst_table}
+   * Selects the table of a sequence code for a block.
+   * @param {number} mode The Symbol compression mode.
+   * @param {!xd3_zstd_fse} table The stream's own table of the code.
+   * @param {?xd3_zstd_fse} previous The table of the previous block.
+   * @param {!Uint8Array} src
+   * @param {number} pos
+   * @param {number} end
+   * @return {number} The position after the table description.
    */
-  function xd3_rfc3284_code_table() {
-    return xd3_build_code_table(__rfc3284_code_table_desc);
-  }
+  xd3_zstd_stream.prototype.select_table = function(mode, table, previous,
+      src, pos, end) {
+    var code = table.code;
+    switch (mode) {
+      case 0:  // Predefined_Mode
+        this.selected = code.predefined;
+        return pos;
+      case 1:  // RLE_Mode
+        if (pos >= end || src[pos] > code.max_symbol) {
+          throw xd3_zstd_error('invalid RLE sequence code');
+        }
+        table.rle(src[pos]);
+        this.selected = table;
+        return pos + 1;
+      case 2:  // FSE_Compressed_Mode
+        pos = table.read(src, pos, end, code.max_symbol, this.norm);
+        this.selected = table;
+        return pos;
+      default:  // Repeat_Mode
+        if (!previous) {
+          throw xd3_zstd_error('repeated sequence table without a table');
+        }
+        this.selected = previous;
+        return pos;
+    }
+  };
 
   /**
-   * Allocates and initializes a Javascript Array.
-   * @return {!Array<number>}
+   * Decodes a compressed block and executes its sequences.
+   * @param {!Uint8Array} src
+   * @param {number} pos
+   * @param {number} end
+   * @param {!Uint8Array} out
+   * @param {number} op
+   * @param {number} frame_start Where the frame's output starts in out.
+   * @return {number} The end of the block's output.
    */
-  function allocArray(len, val) {
-    var arr = new Array(len);
-    for (var i = 0; i < len; i++) {
-      arr[i] = val;
+  xd3_zstd_stream.prototype.decode_block = function(src, pos, end, out, op,
+      frame_start) {
+    pos = this.decode_literals(src, pos, end);
+
+    var nseq = src[pos++];
+    if (nseq >= 128) {
+      if (nseq < 255) {
+        nseq = ((nseq - 128) << 8) + src[pos++];
+      } else {
+        nseq = src[pos] + (src[pos + 1] << 8) + 0x7F00;
+        pos += 2;
+      }
     }
-    return arr;
+    if (pos > end) {
+      throw xd3_zstd_error('sequences exceed block');
+    }
+
+    var lit_src = this.lit_src;
+    var lit_pos = this.lit_pos;
+    var lit_end = this.lit_end;
+    if (nseq > 0) {
+      var modes = src[pos++];
+      if (modes & 3) {
+        throw xd3_zstd_error('reserved sequence modes bits set');
+      }
+      pos = this.select_table(modes >> 6, this.ll_table, this.ll, src, pos,
+          end);
+      var ll = this.ll = this.selected;
+      pos = this.select_table((modes >> 4) & 3, this.of_table, this.of, src,
+          pos, end);
+      var of = this.of = this.selected;
+      pos = this.select_table((modes >> 2) & 3, this.ml_table, this.ml, src,
+          pos, end);
+      var ml = this.ml = this.selected;
+
+      var bits = new xd3_zstd_bits(src, pos, end);
+      var ll_state = bits.read(ll.log);
+      var of_state = bits.read(of.log);
+      var ml_state = bits.read(ml.log);
+      var reps = this.reps;
+      var prefix = this.prefix;
+      var oend = out.length;
+
+      for (var n = 0; n < nseq; n++) {
+        var offset = of.base[of_state] + bits.read_long(of.extra[of_state]);
+        var match_len = ml.base[ml_state] + bits.read(ml.extra[ml_state]);
+        var lit_len = ll.base[ll_state] + bits.read(ll.extra[ll_state]);
+
+        if (offset > 3) {
+          offset -= 3;
+          reps[2] = reps[1];
+          reps[1] = reps[0];
+          reps[0] = offset;
+        } else {
+          var rep = offset - 1 + (lit_len == 0 ? 1 : 0);
+          if (rep == 0) {
+            offset = reps[0];
+          } else {
+            offset = (rep == 3) ? reps[0] - 1 : reps[rep];
+            if (rep != 1) {
+              reps[2] = reps[1];
+            }
+            reps[1] = reps[0];
+            reps[0] = offset;
+          }
+        }
+
+        if (n + 1 < nseq) {
+          ll_state = ll.state[ll_state] + bits.read(ll.nbits[ll_state]);
+          ml_state = ml.state[ml_state] + bits.read(ml.nbits[ml_state]);
+          of_state = of.state[of_state] + bits.read(of.nbits[of_state]);
+        }
+
+        // Execute the sequence: the literals, then the match.
+        if (lit_pos + lit_len > lit_end || op + lit_len + match_len > oend) {
+          throw xd3_zstd_error('sequence exceeds block');
+        }
+        if (lit_len < XD3_MEMCPY_MIN) {
+          for (var i = 0; i < lit_len; i++) {
+            out[op + i] = lit_src[lit_pos + i];
+          }
+        } else {
+          out.set(lit_src.subarray(lit_pos, lit_pos + lit_len), op);
+        }
+        op += lit_len;
+        lit_pos += lit_len;
+
+        var from = op - offset;
+        if (offset == 0) {
+          throw xd3_zstd_error('zero offset');
+        }
+        if (from < frame_start) {
+          // From the dictionary content.
+          var dpos = prefix.length - (frame_start - from);
+          if (dpos < 0) {
+            throw xd3_zstd_error('offset exceeds the window');
+          }
+          var take = Math.min(match_len, prefix.length - dpos);
+          out.set(prefix.subarray(dpos, dpos + take), op);
+          op += take;
+          match_len -= take;
+          from = frame_start;
+        }
+        if (match_len >= XD3_MEMCPY_MIN && offset >= match_len) {
+          out.copyWithin(op, from, from + match_len);
+          op += match_len;
+        } else {
+          for (var i = 0; i < match_len; i++) {
+            out[op++] = out[from + i];
+          }
+        }
+      }
+      if (bits.avail != 0) {
+        throw xd3_zstd_error('invalid sequences bitstream');
+      }
+    } else if (pos != end) {
+      throw xd3_zstd_error('unused sequence section bytes');
+    }
+
+    // The last literals.
+    var rest = lit_end - lit_pos;
+    if (op + rest > out.length) {
+      throw xd3_zstd_error('block exceeds the section');
+    }
+    out.set(lit_src.subarray(lit_pos, lit_end), op);
+    return op + rest;
+  };
+
+  /**
+   * @param {!Uint8Array} src
+   * @param {number} pos
+   * @return {number} The little-endian 32 bit number at pos.
+   */
+  function xd3_zstd_read32(src, pos) {
+    return (src[pos] | (src[pos + 1] << 8) | (src[pos + 2] << 16) |
+            (src[pos + 3] << 24)) >>> 0;
   }
 
   /**
-   * @constructor
+   * Parses a dictionary made by zstd --train.
+   * @param {!Uint8Array} bytes
+   * @return {!xd3_zstd_dict}
    */
-  function xd3_source() {
-    /** @type {number} */
-    this.cpyoff_blkoff = -1;
+  function xd3_zstd_read_dict(bytes) {
+    if (bytes.length < 8 || xd3_zstd_read32(bytes, 0) != ZSTD_DICT_MAGIC) {
+      throw xd3_zstd_error('not a zstd dictionary');
+    }
+    var dict = new xd3_zstd_dict();
+    var stream = new xd3_zstd_stream();
+    dict.bytes = bytes;
+    dict.id = xd3_zstd_read32(bytes, 4);
+    var pos = 8;
+    var end = bytes.length;
+    dict.huf = new xd3_zstd_huf();
+    pos = dict.huf.read(bytes, pos, end, stream);
+    dict.of = new xd3_zstd_fse(xd3_zstd_codes.of);
+    pos = dict.of.read(bytes, pos, end, xd3_zstd_codes.of.max_symbol,
+        stream.norm);
+    dict.ml = new xd3_zstd_fse(xd3_zstd_codes.ml);
+    pos = dict.ml.read(bytes, pos, end, xd3_zstd_codes.ml.max_symbol,
+        stream.norm);
+    dict.ll = new xd3_zstd_fse(xd3_zstd_codes.ll);
+    pos = dict.ll.read(bytes, pos, end, xd3_zstd_codes.ll.max_symbol,
+        stream.norm);
+    if (pos + 12 > end) {
+      throw xd3_zstd_error('truncated dictionary');
+    }
+    for (var i = 0; i < 3; i++) {
+      dict.reps[i] = xd3_zstd_read32(bytes, pos + 4 * i);
+    }
+    dict.content = bytes.slice(pos + 12);
+    for (var i = 0; i < 3; i++) {
+      if (dict.reps[i] == 0 || dict.reps[i] > dict.content.length) {
+        throw xd3_zstd_error('invalid dictionary repeat offsets');
+      }
+    }
+    return dict;
   }
 
+  var xd3_zstd_codes = {
+    ll: new xd3_zstd_code(9, ZSTD_LL_BASE, ZSTD_LL_BITS, ZSTD_LL_DEFAULT, 6),
+    of: new xd3_zstd_code(8, ZSTD_OF_BASE, ZSTD_OF_BITS, ZSTD_OF_DEFAULT, 5),
+    ml: new xd3_zstd_code(9, ZSTD_ML_BASE, ZSTD_ML_BITS, ZSTD_ML_DEFAULT, 6)
+  };
+
+  xd3_sec_types[VCD_ZSTD_ID] = {
+    id: VCD_ZSTD_ID,
+    name: 'zstd',
+    alloc: function() {
+      return new xd3_zstd_stream();
+    },
+    decode: function(stream, input, output) {
+      return stream.decode(input, output);
+    },
+    independent: true
+  };
+
   /**
    * @param {!Uint8Array} bytes
    * @constructor
@@ -880,39 +6036,25 @@
   DataObject.prototype.getInteger = function() {
     var val = 0;
     for (var i = 0; i < 10; i++) {
+      if (this.pos >= this.bytes.length) {
+        throw new Error('end-of-input in read_integer');
+      }
       var aByte = this.bytes[this.pos++];
       val += aByte & 0x7F;
       if (!(aByte & 0x80)) {
         return val;
       }
-      val <<= 7;
+      // Multiply rather than shift, offsets can exceed 32 bits.
+      val *= 128;
     }
     throw new Error('invalid number');
   };
 
-  DataObject.prototype.fill = function(val, length) {
-    // TODO(bstell): see if there is a function for this.
-    for (var i = 0; i < length; i++) {
-      this.bytes[this.pos++] = val;
-    }
-  };
-
-  /**
-   * @param {!xd3_desect} sect
-   * @param {number} length
-   */
-  DataObject.prototype.copySect = function(sect, length) {
-    // TODO(bstell): see if there is a function for this.
-    for (var i = 0; i < length; i++) {
-      this.bytes[this.pos++] = sect.bytes[sect.pos++];
-    }
-  };
-
-  DataObject.prototype.copyBytes = function(bytes, offset, length) {
-    // TODO(bstell): see if there is a function for this.
-    for (var i = 0; i < length; i++) {
-      this.bytes[this.pos++] = bytes[offset++];
-    }
-  };
+  /* When this file is the script of a worker started by decodeParallel,
+   * decode the windows it is sent. */
+  if (typeof WorkerGlobalScope != 'undefined' &&
+      window.name == XD3_WORKER_NAME) {
+    window.onmessage = xd3_worker_onmessage;
+  }
 
-})();
+})(typeof window != 'undefined' ? window : self);